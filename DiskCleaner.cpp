@@ -20,6 +20,20 @@
 #include <fcntl.h>
 #include <fstream>
 
+#include "DiskCleanerEngine.h"
+#include "DiskCleanerWalker.h"
+#include "DiskCleanerSizeIndex.h"
+#include "DiskCleanerWatcher.h"
+#include "DiskCleanerDevices.h"
+#include "DiskCleanerLogRing.h"
+#include "DiskCleanerProgress.h"
+#include "DiskCleanerTrace.h"
+#include "DiskCleanerFilter.h"
+#include "DiskCleanerBudget.h"
+#include "DiskCleanerDuplicates.h"
+#include "DiskCleanerTopK.h"
+#include "DiskCleanerUsageIndex.h"
+
 #pragma comment(lib, "comctl32.lib")
 #pragma comment(lib, "shell32.lib")
 
@@ -47,16 +61,24 @@ namespace fs = std::filesystem;
 
 
 #define VERSION_MAJOR 2
-#define VERSION_MINOR 4
+#define VERSION_MINOR 5
 #define VERSION_PATCH 0
-#define VERSION_SUFFIX "c"
+#define VERSION_SUFFIX ""
 
-#define VERSION_STRING "2.4.0c"
+#define VERSION_STRING "2.5.0"
 #define APP_TITLE_STRING "DiskCleaner v" VERSION_STRING
 
 
 #define WINDOW_WIDTH 800
 #define WINDOW_HEIGHT 600
+#define CLEANUP_ITEM_TIME_LIMIT_SEC 60
+#define LOG_FLUSH_INTERVAL_MS 33
+#define LOG_RING_CAPACITY 16384
+#define PROGRESS_SAMPLE_INTERVAL_MS 250
+#define SIZE_ITEM_TIME_LIMIT_SEC 30
+#define DUPLICATE_GROUPS_SHOWN 20
+#define LARGEST_SHOWN 15
+#define BREAKDOWN_CHILDREN_SHOWN 10
 #define ID_LISTVIEW 1001
 #define ID_BTN_SELECTALL 1002
 #define ID_BTN_DESELECTALL 1003
@@ -72,26 +94,17 @@ namespace fs = std::filesystem;
 #define ID_BTN_VERBOSE_INFO 1013
 #define ID_MENU_ADD_DIR 1014
 #define ID_MENU_REMOVE_DIR 1015
-
-struct CleanupItem {
-    std::string name;
-    std::string path;
-    std::string description;
-    bool enabled;
-    bool requiresAdmin;
-    bool isCustom;
-    uintmax_t size;
-};
-
-struct CleanupResult {
-    std::string itemName;
-    uintmax_t bytesRemoved;
-    int filesDeleted;
-    int filesSkipped;
-    bool success;
-    std::string errorMessage;
-    std::chrono::milliseconds duration;
-};
+#define ID_MENU_LIVE_SIZES 1016
+#define ID_MENU_PAUSE 1017
+#define ID_MENU_CANCEL 1018
+#define ID_MENU_TRACE 1019
+#define ID_MENU_BUDGET_OFF 1020
+#define ID_MENU_BUDGET_LAST 1024
+#define ID_MENU_DUPLICATES 1025
+#define ID_MENU_LARGEST 1026
+#define ID_MENU_TIME_LIMITS 1027
+#define ID_TIMER_LOG_FLUSH 1
+#define ID_TIMER_PROGRESS 2
 
 class DiskCleanerGUI {
 private:
@@ -111,12 +124,42 @@ private:
     HWND hwndBtnVerboseInfo;
     
     std::vector<CleanupItem> cleanupItems;
+    SizeIndex sizeIndex;
+    UsageIndex usageIndex;  // usage_index.bin, rewritten after every size calculation
+    std::mutex usageIndexMutex;
+    DeviceTuning deviceTuning;
+    PathFilter cleanupFilter;  // from cleanup_filters.txt, read once at startup
     bool dryRunMode = false;
     bool verboseMode = false;
     std::atomic<int> completedTasks{0};
     std::atomic<int> totalTasks{0};
-    std::mutex logMutex;
+    // A line carries the clear generation it was written in; ClearResults bumps the
+    // generation outside the ring, so a full ring can drop lines but never a clear.
+    struct LogLine {
+        uint64_t generation = 0;
+        std::string text;
+    };
+    MpscRing<LogLine> logRing{LOG_RING_CAPACITY};
+    std::atomic<uint64_t> logGeneration{0};
+    uint64_t shownLogGeneration = 0;  // UI thread
+    
+    // The operation whose progress the bar shows. Installed and finished by the thread
+    // running it (std::atomic_store), read by the UI timer (std::atomic_load).
+    struct ProgressSource {
+        std::string label;
+        std::shared_ptr<ProgressCounters> counters;
+        std::unique_ptr<ProgressSampler> sampler;
+    };
+    std::shared_ptr<ProgressSource> progressSource;
+    uint64_t shownProgressSequence = 0;
     bool isCleanupRunning = false;
+    std::atomic<bool> liveSizesEnabled{false};
+    std::atomic<bool> traceCleanup{false};
+    std::atomic<bool> itemTimeLimits{false};  // off: items run until done, paused or cancelled
+    uint64_t freeBudgetBytes = 0;  // 0: clean everything selected
+    std::shared_ptr<CancellationToken> liveSizesControl;  // of the running tracking loop
+    CancellationToken appControl;
+    CancellationToken cleanupControl{&appControl};
 
     static LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam) {
         DiskCleanerGUI* pThis = nullptr;
@@ -143,9 +186,23 @@ private:
                 CreateControls();
                 SetupCleanupItems();
                 PopulateListView();
+                sizeIndex.Load("size_index.bin");
+                usageIndex.Open("usage_index.bin");
+                deviceTuning.Load("device_tuning.txt");
+                LoadCleanupFilter();
+                SetTimer(hwndMain, ID_TIMER_LOG_FLUSH, LOG_FLUSH_INTERVAL_MS, nullptr);
+                SetTimer(hwndMain, ID_TIMER_PROGRESS, PROGRESS_SAMPLE_INTERVAL_MS, nullptr);
                 std::thread([this]() { CalculateSizesAsync(); }).detach();
                 return 0;
                 
+            case WM_TIMER:
+                if (wParam == ID_TIMER_LOG_FLUSH) {
+                    FlushLog();
+                } else if (wParam == ID_TIMER_PROGRESS) {
+                    RenderProgress();
+                }
+                return 0;
+                
             case WM_COMMAND:
                 if (lParam == 0) { 
                     HandleMenuCommand(LOWORD(wParam));
@@ -165,6 +222,10 @@ private:
                 PopulateListView();
                 return 0;
                 
+            case WM_USER + 2:
+                ApplyLiveSizes(reinterpret_cast<LiveSizes*>(lParam));
+                return 0;
+                
             case WM_CLOSE:
                 if (isCleanupRunning) {
                     if (MessageBox(hwndMain, L"Cleanup is running. Are you sure you want to exit?", 
@@ -172,10 +233,14 @@ private:
                         return 0;
                     }
                 }
+                appControl.Cancel();
                 DestroyWindow(hwndMain);
                 return 0;
                 
             case WM_DESTROY:
+                KillTimer(hwndMain, ID_TIMER_LOG_FLUSH);
+                KillTimer(hwndMain, ID_TIMER_PROGRESS);
+                StopLiveSizes();
                 PostQuitMessage(0);
                 return 0;
                 
@@ -219,9 +284,29 @@ private:
         AppendMenu(hFileMenu, MF_STRING, ID_MENU_ADD_DIR, L"&Add Directory...");
         AppendMenu(hFileMenu, MF_STRING, ID_MENU_REMOVE_DIR, L"&Remove Selected Directory");
         AppendMenu(hFileMenu, MF_SEPARATOR, 0, nullptr);
+        AppendMenu(hFileMenu, MF_STRING, ID_MENU_LIVE_SIZES, L"&Live Size Tracking (Polled)");
+        AppendMenu(hFileMenu, MF_STRING, ID_MENU_TRACE, L"Record &Trace");
+        AppendMenu(hFileMenu, MF_STRING, ID_MENU_DUPLICATES, L"Find &Duplicates...");
+        AppendMenu(hFileMenu, MF_STRING, ID_MENU_LARGEST, L"Show La&rgest Files");
+        AppendMenu(hFileMenu, MF_SEPARATOR, 0, nullptr);
         AppendMenu(hFileMenu, MF_STRING, SC_CLOSE, L"E&xit");
         
+        HMENU hCleanupMenu = CreatePopupMenu();
+        AppendMenu(hCleanupMenu, MF_STRING | MF_GRAYED, ID_MENU_PAUSE, L"&Pause");
+        AppendMenu(hCleanupMenu, MF_STRING | MF_GRAYED, ID_MENU_CANCEL, L"&Cancel");
+        AppendMenu(hCleanupMenu, MF_SEPARATOR, 0, nullptr);
+        AppendMenu(hCleanupMenu, MF_STRING, ID_MENU_TIME_LIMITS, L"Item &Time Limits");
+        HMENU hBudgetMenu = CreatePopupMenu();
+        for (UINT id = ID_MENU_BUDGET_OFF; id <= ID_MENU_BUDGET_LAST; ++id) {
+            uint64_t bytes = BudgetChoice(id);
+            AppendMenu(hBudgetMenu, MF_STRING, id,
+                       bytes ? StringToWString("Free " + FormatBytes(bytes) + ", Oldest First").c_str() : L"&Off (Clean Everything)");
+        }
+        CheckMenuRadioItem(hBudgetMenu, ID_MENU_BUDGET_OFF, ID_MENU_BUDGET_LAST, ID_MENU_BUDGET_OFF, MF_BYCOMMAND);
+        AppendMenu(hCleanupMenu, MF_POPUP, (UINT_PTR)hBudgetMenu, L"Free Space &Budget");
+        
         AppendMenu(hMenuBar, MF_POPUP, (UINT_PTR)hFileMenu, L"&File");
+        AppendMenu(hMenuBar, MF_POPUP, (UINT_PTR)hCleanupMenu, L"&Cleanup");
         SetMenu(hwndMain, hMenuBar);
         
         hwndListView = CreateWindowEx(
@@ -391,6 +476,12 @@ private:
         }
     }
 
+    // Byte budgets offered under Cleanup > Free Space Budget, by menu id.
+    static uint64_t BudgetChoice(UINT id) {
+        static const uint64_t gigabytes[] = {0, 1, 10, 50, 100};
+        return gigabytes[id - ID_MENU_BUDGET_OFF] << 30;
+    }
+
     void HandleMenuCommand(WORD commandId) {
         switch (commandId) {
             case ID_MENU_ADD_DIR:
@@ -401,6 +492,67 @@ private:
                 RemoveSelectedDirectory();
                 break;
                 
+            case ID_MENU_LIVE_SIZES:
+                if (liveSizesEnabled) {
+                    StopLiveSizes();
+                } else {
+                    StartLiveSizes();
+                }
+                CheckMenuItem(GetMenu(hwndMain), ID_MENU_LIVE_SIZES,
+                              MF_BYCOMMAND | (liveSizesEnabled ? MF_CHECKED : MF_UNCHECKED));
+                break;
+                
+            case ID_MENU_TRACE:
+                traceCleanup = !traceCleanup;
+                CheckMenuItem(GetMenu(hwndMain), ID_MENU_TRACE,
+                              MF_BYCOMMAND | (traceCleanup ? MF_CHECKED : MF_UNCHECKED));
+                break;
+                
+            case ID_MENU_TIME_LIMITS:
+                itemTimeLimits = !itemTimeLimits;
+                CheckMenuItem(GetMenu(hwndMain), ID_MENU_TIME_LIMITS,
+                              MF_BYCOMMAND | (itemTimeLimits ? MF_CHECKED : MF_UNCHECKED));
+                break;
+                
+            case ID_MENU_DUPLICATES:
+                if (!isCleanupRunning) {
+                    std::thread([this]() { FindDuplicates(); }).detach();
+                }
+                break;
+                
+            case ID_MENU_LARGEST:
+                if (!isCleanupRunning) {
+                    std::thread([this]() { ShowLargest(); }).detach();
+                }
+                break;
+                
+            case ID_MENU_BUDGET_OFF:
+            case ID_MENU_BUDGET_OFF + 1:
+            case ID_MENU_BUDGET_OFF + 2:
+            case ID_MENU_BUDGET_OFF + 3:
+            case ID_MENU_BUDGET_LAST:
+                freeBudgetBytes = BudgetChoice(commandId);
+                CheckMenuRadioItem(GetMenu(hwndMain), ID_MENU_BUDGET_OFF, ID_MENU_BUDGET_LAST, commandId, MF_BYCOMMAND);
+                break;
+                
+            case ID_MENU_PAUSE:
+                if (cleanupControl.IsPaused()) {
+                    cleanupControl.Resume();
+                    SetStatusText("Cleanup resumed.");
+                } else {
+                    cleanupControl.Pause();
+                    SetStatusText("Cleanup paused.");
+                }
+                CheckMenuItem(GetMenu(hwndMain), ID_MENU_PAUSE,
+                              MF_BYCOMMAND | (cleanupControl.IsPaused() ? MF_CHECKED : MF_UNCHECKED));
+                break;
+                
+            case ID_MENU_CANCEL:
+                cleanupControl.Cancel();
+                cleanupControl.Resume();
+                AppendToResults("⏹️ Cancelling cleanup...");
+                break;
+                
             case SC_CLOSE:
                 PostMessage(hwndMain, WM_CLOSE, 0, 0);
                 break;
@@ -420,9 +572,55 @@ private:
                 }
             }
         }
+        if (pnmh->idFrom == ID_LISTVIEW && pnmh->code == NM_DBLCLK) {
+            int selected = ListView_GetNextItem(hwndListView, -1, LVNI_SELECTED);
+            if (selected >= 0) ShowBreakdown(static_cast<size_t>(selected));
+        }
         return 0;
     }
 
+    // Double-click on an item: its largest subdirectories from the usage index of the
+    // last size calculation, without touching the disk.
+    void ShowBreakdown(size_t itemIndex) {
+        if (itemIndex >= cleanupItems.size() || cleanupItems[itemIndex].path == "RECYCLE_BIN") return;
+        const CleanupItem& item = cleanupItems[itemIndex];
+        std::lock_guard<std::mutex> lock(usageIndexMutex);
+        uint32_t node = usageIndex.IsOpen() ? usageIndex.Find(item.path) : UsageIndex::None;
+        if (node == UsageIndex::None) {
+            AppendToResults("📂 " + item.name + " - no breakdown yet, refresh the sizes first");
+            return;
+        }
+
+        uint64_t total = usageIndex.SubtreeBytes(node);
+        auto share = [total](uint64_t bytes) {
+            return " (" + std::to_string(total ? bytes * 100 / total : 0) + "%)";
+        };
+        AppendToResults("📂 " + item.name + ": " + FormatBytes(total) + " in " + std::to_string(usageIndex.SubtreeFiles(node)) +
+                       " files, " + std::to_string(usageIndex.ChildCount(node)) + " subdirectories");
+        uint32_t first = usageIndex.FirstChild(node);
+        uint32_t shown = (std::min)(usageIndex.ChildCount(node), static_cast<uint32_t>(BREAKDOWN_CHILDREN_SHOWN));
+        for (uint32_t child = first; child < first + shown; ++child) {
+            AppendToResults("      " + FormatBytes(usageIndex.SubtreeBytes(child)) + share(usageIndex.SubtreeBytes(child)) +
+                           "  " + std::string(usageIndex.Name(child)));
+        }
+        if (usageIndex.OwnFiles(node)) {
+            AppendToResults("      " + FormatBytes(usageIndex.OwnBytes(node)) + share(usageIndex.OwnBytes(node)) +
+                           "  (" + std::to_string(usageIndex.OwnFiles(node)) + " files directly inside)");
+        }
+    }
+
+    // The mapping is closed first: Windows cannot replace a file that is still mapped.
+    void SaveUsageIndex() {
+        std::vector<std::string> roots;
+        for (const auto& item : cleanupItems) {
+            if (item.path != "RECYCLE_BIN") roots.push_back(item.path);
+        }
+        std::lock_guard<std::mutex> lock(usageIndexMutex);
+        usageIndex.Close();
+        UsageIndex::Write("usage_index.bin", sizeIndex, roots);
+        usageIndex.Open("usage_index.bin");
+    }
+
     void SelectAllItems(bool select) {
         int itemCount = ListView_GetItemCount(hwndListView);
         for (int i = 0; i < itemCount; ++i) {
@@ -512,27 +710,103 @@ private:
         SetWindowText(hwndStatus, wtext.c_str());
     }
 
+    // Pause/Cancel are only meaningful while a cleanup runs.
+    void EnableCleanupMenu(bool enable) {
+        HMENU hMenu = GetMenu(hwndMain);
+        EnableMenuItem(hMenu, ID_MENU_PAUSE, MF_BYCOMMAND | (enable ? MF_ENABLED : MF_GRAYED));
+        EnableMenuItem(hMenu, ID_MENU_CANCEL, MF_BYCOMMAND | (enable ? MF_ENABLED : MF_GRAYED));
+        CheckMenuItem(hMenu, ID_MENU_PAUSE, MF_BYCOMMAND | MF_UNCHECKED);
+    }
+
+    // Any thread. The line is queued and shows up with the next FlushLog; a full ring
+    // drops it rather than making the caller wait for the UI.
     void AppendToResults(const std::string& text) {
-        std::lock_guard<std::mutex> lock(logMutex);
+        logRing.TryPush(LogLine{logGeneration.load(std::memory_order_acquire), text});
+    }
+
+    // Any thread. Lines written before this are discarded by the next FlushLog, whether
+    // they are still in the ring or already shown.
+    void ClearResults() {
+        logGeneration.fetch_add(1, std::memory_order_acq_rel);
+    }
+
+    // UI thread, every LOG_FLUSH_INTERVAL_MS: everything queued goes into the results
+    // view with one EM_REPLACESEL.
+    void FlushLog() {
+        std::string batch;
+        bool clear = false;
+        auto clearUpTo = [&](uint64_t generation) {
+            batch.clear();
+            clear = true;
+            shownLogGeneration = generation;
+        };
+        uint64_t generation = logGeneration.load(std::memory_order_acquire);
+        if (generation != shownLogGeneration) clearUpTo(generation);
+        logRing.Drain([&](LogLine&& line) {
+            if (line.generation < shownLogGeneration) return;
+            // Cleared again while draining.
+            if (line.generation > shownLogGeneration) clearUpTo(line.generation);
+            batch += line.text;
+            batch += "\r\n";
+        });
+        if (uint64_t dropped = logRing.TakeDropped()) {
+            batch += "⚠️ " + std::to_string(dropped) + " log lines dropped (logging faster than the view can show)\r\n";
+        }
+        if (clear) {
+            SetWindowText(hwndResults, L"");
+        }
+        if (batch.empty()) return;
         
         int length = GetWindowTextLength(hwndResults);
-        
         SendMessage(hwndResults, EM_SETSEL, length, length);
-        std::wstring wtext = StringToWString(text + "\r\n");
+        std::wstring wtext = StringToWString(batch);
         SendMessage(hwndResults, EM_REPLACESEL, FALSE, (LPARAM)wtext.c_str());
-        
         SendMessage(hwndResults, EM_SCROLLCARET, 0, 0);
     }
 
-    void UpdateProgress(int current, int total) {
-        if (total > 0) {
-            int percent = (current * 100) / total;
-            SendMessage(hwndProgressOverall, PBM_SETPOS, percent, 0);
-            
-            std::ostringstream oss;
-            oss << "Progress: " << current << "/" << total << " (" << percent << "%)";
-            SetStatusText(oss.str());
+    // Thread running the operation. totalBytes is the pre-scan estimate (0 = count
+    // items only); workers report into the returned counters.
+    std::shared_ptr<ProgressSource> BeginProgress(const std::string& label, uint64_t totalBytes, uint64_t totalItems) {
+        auto source = std::make_shared<ProgressSource>();
+        source->label = label;
+        source->counters = std::make_shared<ProgressCounters>();
+        source->sampler = std::make_unique<ProgressSampler>(source->counters, totalBytes, totalItems,
+                                                            std::chrono::milliseconds(PROGRESS_SAMPLE_INTERVAL_MS));
+        source->sampler->Start();
+        std::atomic_store(&progressSource, source);
+        return source;
+    }
+
+    // Thread running the operation, once its workers are done and before it sets its
+    // final status text: the finished snapshot only moves the bar to 100%.
+    void EndProgress(const std::shared_ptr<ProgressSource>& source) {
+        source->sampler->Stop();
+    }
+
+    // UI thread, every PROGRESS_SAMPLE_INTERVAL_MS.
+    void RenderProgress() {
+        auto source = std::atomic_load(&progressSource);
+        if (!source) return;
+        auto snapshot = source->sampler->Latest();
+        if (snapshot->sequence == shownProgressSequence) return;
+        shownProgressSequence = snapshot->sequence;
+        
+        SendMessage(hwndProgressOverall, PBM_SETPOS, static_cast<int>(snapshot->Fraction() * 100), 0);
+        if (snapshot->finished) {
+            std::atomic_compare_exchange_strong(&progressSource, &source, std::shared_ptr<ProgressSource>());
+            return;
         }
+        if (cleanupControl.IsPaused()) return;  // keep "Cleanup paused." visible
+        
+        std::ostringstream oss;
+        oss << source->label << ": ";
+        if (snapshot->totalBytes) {
+            oss << FormatBytes(snapshot->done.bytes) << " of " << FormatBytes(snapshot->totalBytes) << " ("
+                << static_cast<int>(snapshot->Fraction() * 100) << "%) | " << FormatBytes(static_cast<uintmax_t>(snapshot->bytesPerSecond))
+                << "/s, " << static_cast<uint64_t>(snapshot->filesPerSecond) << " files/s | ";
+        }
+        oss << snapshot->done.items << "/" << snapshot->totalItems << " items";
+        SetStatusText(oss.str());
     }
 
     void UpdateStatusBar() {
@@ -560,7 +834,9 @@ private:
             for (const auto& item : cleanupItems) {
                 if (item.isCustom) {
                     file << item.name << "|" << item.path << "|" << item.description << "|" 
-                         << (item.enabled ? "1" : "0") << std::endl;
+                         << (item.enabled ? "1" : "0");
+                    if (item.retention.Active()) file << "|" << item.retention.ToString();
+                    file << std::endl;
                 }
             }
             file.close();
@@ -573,16 +849,21 @@ private:
             std::string line;
             while (std::getline(file, line)) {
                 std::istringstream iss(line);
-                std::string name, path, description, enabledStr;
+                std::string name, path, description, enabledStr, retentionSpec;
                 
                 if (std::getline(iss, name, '|') && 
                     std::getline(iss, path, '|') && 
                     std::getline(iss, description, '|') && 
-                    std::getline(iss, enabledStr)) {
+                    std::getline(iss, enabledStr, '|')) {
                     
+                    // Optional fifth field: a retention spec such as "days=30,keep=10".
+                    std::getline(iss, retentionSpec);
                     bool enabled = (enabledStr == "1");
                     if (fs::exists(path)) {
                         cleanupItems.push_back({name, path, description, enabled, false, true, 0});
+                        if (!RetentionPolicy::Parse(retentionSpec, cleanupItems.back().retention)) {
+                            AppendToResults("❌ " + name + " - retention \"" + retentionSpec + "\" ignored");
+                        }
                     }
                 }
             }
@@ -621,6 +902,7 @@ private:
                     
                     SaveCustomDirectories();
                     PopulateListView();
+                    RestartLiveSizes();
                     
                     std::thread([this]() { CalculateSizesAsync(); }).detach();
                     
@@ -658,6 +940,7 @@ private:
                 cleanupItems.erase(cleanupItems.begin() + selectedIndex);
                 SaveCustomDirectories();
                 PopulateListView();
+                RestartLiveSizes();
                 UpdateStatusBar();
             }
         }
@@ -698,6 +981,7 @@ private:
         }
 
         cleanupItems.push_back({"Windows Logs", "C:\\Windows\\Logs", "System log files", true, true, false, 0});
+        cleanupItems.back().retention.olderThanDays = 7;
         cleanupItems.push_back({"Error Reports", "C:\\ProgramData\\Microsoft\\Windows\\WER\\ReportQueue", "Windows Error Reports", true, true, false, 0});
         cleanupItems.push_back({"Memory Dumps", "C:\\Windows\\Minidump", "System crash dump files", true, true, false, 0});
         
@@ -723,6 +1007,7 @@ private:
         }
 
         cleanupItems.push_back({"IIS Logs", "C:\\inetpub\\logs\\LogFiles", "IIS web server logs", false, true, false, 0});
+        cleanupItems.back().retention.olderThanDays = 7;
         cleanupItems.push_back({"Event Logs", "C:\\Windows\\System32\\winevt\\Logs", "Windows Event Logs (*.evtx)", false, true, false, 0});
         
         cleanupItems.push_back({"Recycle Bin", "RECYCLE_BIN", "Files in Recycle Bin", true, false, false, 0});
@@ -774,51 +1059,28 @@ private:
     }
 
     uintmax_t GetFolderSize(const std::string& folderPath) {
-        uintmax_t totalSize = 0;
-        std::error_code ec;
-        
-        try {
-            for (const auto& entry : fs::recursive_directory_iterator(folderPath, 
-                fs::directory_options::skip_permission_denied, ec)) {
-                if (ec) break;
-                
-                if (entry.is_regular_file(ec) && !ec) {
-                    auto fileSize = entry.file_size(ec);
-                    if (!ec) {
-                        totalSize += fileSize;
-                    }
-                }
-            }
-        } catch (const std::exception&) {
-        }
-        
-        return totalSize;
+        WalkOptions options;
+        options.scheduler = &TaskScheduler::Shared();
+        return GetFolderSizeParallel(folderPath, options);
     }
 
-    uintmax_t GetFolderSizeFast(const std::string& folderPath) {
-        uintmax_t totalSize = 0;
-        std::error_code ec;
+    // Only directories whose mtime changed since the last refresh are listed again.
+    uintmax_t GetFolderSizeFast(const std::string& folderPath, const CancellationToken* cancel = nullptr) {
+        WalkOptions options;
+        options.followDirectorySymlinks = true;
+        options.scheduler = &TaskScheduler::Shared();
+        options.cancel = cancel;
+        WalkTotals totals = sizeIndex.Refresh(folderPath, options);
         
-        try {
-            auto iter = fs::recursive_directory_iterator(folderPath, 
-                fs::directory_options::skip_permission_denied | fs::directory_options::follow_directory_symlink, ec);
-            
-            if (ec) return 0;
-            
-            for (const auto& entry : iter) {
-                try {
-                    if (entry.is_regular_file()) {
-                        totalSize += entry.file_size();
-                    }
-                } catch (...) {
-                    continue;
-                }
-            }
-        } catch (...) {
-            return 0;
+        if (totals.stopped) {
+            AppendToResults(folderPath + ": size is partial (" + StopReasonText(cancel->Reason()) + ")");
         }
         
-        return totalSize;
+        if (verboseMode && (totals.duplicateBytes > 0 || totals.skippedDirectories > 0)) {
+            AppendToResults(folderPath + ": " + FormatBytes(totals.duplicateBytes) + " of hard links counted once, " +
+                            std::to_string(totals.skippedDirectories) + " directories reached twice via symlinks");
+        }
+        return totals.bytes;
     }
 
     uintmax_t GetRecycleBinSize() {
@@ -861,51 +1123,123 @@ private:
         SetStatusText("Size calculation...");
         EnableWindow(hwndBtnRefresh, FALSE);
         
-        std::atomic<int> completedItems{0};
-        std::vector<std::thread> sizeThreads;
+        auto progress = BeginProgress("Size calculation", 0, cleanupItems.size());
+        TaskGroup sizeTasks;
         
         for (size_t i = 0; i < cleanupItems.size(); ++i) {
-            sizeThreads.emplace_back([this, i, &completedItems]() {
+            sizeTasks.Run([this, i, &progress]() {
                 try {
                     if (cleanupItems[i].path == "RECYCLE_BIN") {
                         cleanupItems[i].size = GetRecycleBinSize();
                     } else {
-                        cleanupItems[i].size = GetFolderSizeFast(cleanupItems[i].path);
+                        CancellationToken itemControl(&appControl);
+                        if (itemTimeLimits) itemControl.SetTimeout(std::chrono::seconds(SIZE_ITEM_TIME_LIMIT_SEC));
+                        cleanupItems[i].size = GetFolderSizeFast(cleanupItems[i].path, &itemControl);
                     }
                 } catch (...) {
                     cleanupItems[i].size = 0;
                 }
                 
-                completedItems++;
-                
-                if (completedItems.load() % 3 == 0 || completedItems.load() == static_cast<int>(cleanupItems.size())) {
-                    UpdateProgress(completedItems.load(), static_cast<int>(cleanupItems.size()));
-                }
+                progress->counters->ItemDone();
             });
         }
         
-        auto startTime = std::chrono::high_resolution_clock::now();
-        for (auto& thread : sizeThreads) {
-            if (thread.joinable()) {
-                thread.join();
-            }
-            
-            auto elapsed = std::chrono::high_resolution_clock::now() - startTime;
-            if (std::chrono::duration_cast<std::chrono::seconds>(elapsed).count() > 30) {
-                for (auto& remainingThread : sizeThreads) {
-                    if (remainingThread.joinable()) {
-                        remainingThread.detach();
-                    }
-                }
-                break;
-            }
-        }
+        sizeTasks.Wait();
+        EndProgress(progress);
+        
+        sizeIndex.Save("size_index.bin");
+        SaveUsageIndex();
         
         PostMessage(hwndMain, WM_USER + 1, 0, 0);
         EnableWindow(hwndBtnRefresh, TRUE);
         SetStatusText("⚡ Size calculation complete!");
     }
 
+    // Root path and bytes, posted from the tracking loop as the lParam of WM_USER + 2.
+    using LiveSizes = std::vector<std::pair<std::string, uintmax_t>>;
+
+    void StartLiveSizes() {
+        std::vector<std::string> roots;
+        for (const auto& item : cleanupItems) {
+            if (item.path != "RECYCLE_BIN") roots.push_back(item.path);
+        }
+        liveSizesEnabled = true;
+        liveSizesControl = std::make_shared<CancellationToken>(&appControl);
+        std::thread([this, control = liveSizesControl, roots = std::move(roots)]() {
+            LiveSizesLoop(*control, roots);
+        }).detach();
+    }
+
+    // Does not wait: the loop may be in the middle of its initial scan, which sees the
+    // cancel at its next checkpoint and ends with the loop.
+    void StopLiveSizes() {
+        liveSizesEnabled = false;
+        if (liveSizesControl) {
+            liveSizesControl->Cancel();
+            liveSizesControl.reset();
+        }
+    }
+
+    // The tracked roots are fixed when tracking starts; a changed list starts it over.
+    void RestartLiveSizes() {
+        if (!liveSizesEnabled) return;
+        StopLiveSizes();
+        StartLiveSizes();
+    }
+
+    // Keeps the size of every directory root current until control is cancelled. Windows
+    // has no change notifications here, so the watcher re-checks each directory's stamp
+    // every rescan interval. Sizes go to the UI thread keyed by path, never by item index.
+    void LiveSizesLoop(const CancellationToken& control, const std::vector<std::string>& roots) {
+        WatchOptions watchOptions;
+        watchOptions.cancel = &control;
+        SizeWatcher watcher(watchOptions);
+        std::vector<std::pair<std::string, size_t>> tracked;
+        
+        for (const auto& root : roots) {
+            if (control.StopRequested()) return;
+            std::error_code ec;
+            if (!fs::is_directory(root, ec)) continue;
+            tracked.emplace_back(root, watcher.AddRoot(root));
+        }
+        if (control.StopRequested()) return;
+        
+        WatchStats stats = watcher.Stats();
+        std::ostringstream oss;
+        oss << "Live size tracking: " << stats.directories << " directories, " << stats.watchedDirectories
+            << " watched, " << stats.unwatchedDirectories << " polled, "
+            << static_cast<int>(stats.BytesPerDirectory()) << " bytes/directory";
+        if (!watcher.HasNotifications()) {
+            oss << " (no change notifications: checked every "
+                << std::chrono::duration_cast<std::chrono::seconds>(watchOptions.rescanInterval).count() << " s)";
+        }
+        AppendToResults(oss.str());
+        
+        while (!control.StopRequested()) {
+            if (!watcher.Poll(std::chrono::milliseconds(500))) continue;
+            
+            auto sizes = std::make_unique<LiveSizes>();
+            for (const auto& [path, root] : tracked) {
+                sizes->emplace_back(path, watcher.RootBytes(root));
+            }
+            if (!control.StopRequested() && PostMessage(hwndMain, WM_USER + 2, 0, reinterpret_cast<LPARAM>(sizes.get()))) {
+                sizes.release();
+            }
+        }
+    }
+
+    // UI thread: takes over sizes from the tracking loop.
+    void ApplyLiveSizes(LiveSizes* posted) {
+        std::unique_ptr<LiveSizes> sizes(posted);
+        if (isCleanupRunning) return;
+        for (auto& item : cleanupItems) {
+            for (const auto& [path, bytes] : *sizes) {
+                if (item.path == path) item.size = bytes;
+            }
+        }
+        PopulateListView();
+    }
+
     bool IsDirectoryEmptyOrInaccessible(const std::string& folderPath) {
         if (folderPath == "RECYCLE_BIN") return false;
         
@@ -923,9 +1257,14 @@ private:
         }
     }
 
-    CleanupResult DeleteFolderContentsParallel(const std::string& folderPath, const std::string& itemName) {
+    CleanupResult DeleteFolderContentsParallel(const std::string& folderPath, const std::string& itemName,
+                                               const CancellationToken* cancel = nullptr,
+                                               const DeviceGroup* device = nullptr,
+                                               ProgressCounters* progress = nullptr,
+                                               const RetentionPolicy& retention = {},
+                                               FreeSpaceBudget* budget = nullptr) {
         auto startTime = std::chrono::high_resolution_clock::now();
-        CleanupResult result{itemName, 0, 0, 0, true, "", std::chrono::milliseconds(0)};
+        CleanupResult result{itemName, 0, 0, 0, true, "", std::chrono::milliseconds(0), 0};
 
         if (IsDirectoryEmptyOrInaccessible(folderPath)) {
             AppendToResults(itemName + " - Skipped (empty or inaccessible)");
@@ -958,6 +1297,7 @@ private:
                             result.bytesRemoved = sizeBefore;
                             result.filesDeleted = 1;
                             result.success = true;
+                            if (progress) progress->Add(sizeBefore, 0, 0);
                             AppendToResults("Recycle Bin emptied successfully - " + FormatBytes(sizeBefore) + " freed");
                         } else {
                             if (hr == 0x8000ffff || hr == S_FALSE) {
@@ -988,98 +1328,44 @@ private:
         
         if (dryRunMode) {
             AppendToResults("[DRY RUN] Would clean: " + itemName);
-            result.bytesRemoved = GetFolderSize(folderPath);
-            auto endTime = std::chrono::high_resolution_clock::now();
-            result.duration = std::chrono::duration_cast<std::chrono::milliseconds>(endTime - startTime);
-            return result;
         }
 
-        uintmax_t sizeBefore = GetFolderSize(folderPath);
-        std::error_code ec;
-        
         try {
-            std::vector<fs::path> itemsToDelete;
-            
-            for (const auto& entry : fs::directory_iterator(folderPath, ec)) {
-                if (!ec) {
-                    itemsToDelete.push_back(entry.path());
-                }
-            }
-            
-            const size_t maxThreads = std::thread::hardware_concurrency() * 2;
-            const size_t batchSize = (std::max)(size_t(1), itemsToDelete.size() / maxThreads);
-            
-            std::vector<std::thread> deleteThreads;
-            std::atomic<int> deleted{0}, skipped{0};
-            
-            for (size_t i = 0; i < itemsToDelete.size(); i += batchSize) {
-                size_t endIdx = (std::min)(i + batchSize, itemsToDelete.size());
-                
-                deleteThreads.emplace_back([this, &itemsToDelete, i, endIdx, &deleted, &skipped]() {
-                    int localDeleted = 0, localSkipped = 0;
-                    
-                    for (size_t j = i; j < endIdx; ++j) {
-                        const auto& item = itemsToDelete[j];
-                        std::error_code ec;
-                        
-                        try {
-                            if (fs::is_regular_file(item, ec) && !ec) {
-                                if (fs::remove(item, ec) && !ec) {
-                                    localDeleted++;
-                                } else {
-                                    localSkipped++;
-                                }
-                            } else if (fs::is_directory(item, ec) && !ec) {
-                                auto removed = fs::remove_all(item, ec);
-                                if (!ec && removed > 0) {
-                                    localDeleted += static_cast<int>(removed);
-                                } else {
-                                    localSkipped++;
-                                }
-                            } else {
-                                localSkipped++;
-                            }
-                        } catch (...) {
-                            localSkipped++;
-                        }
-                    }
-                    
-                    deleted += localDeleted;
-                    skipped += localSkipped;
-                });
+            DeleteOptions options;
+            options.dryRun = dryRunMode;
+            options.scheduler = &TaskScheduler::Shared();
+            options.cancel = cancel;
+            options.adaptive = true;
+            options.progress = progress;
+            options.filter = &cleanupFilter;
+            options.retention = retention;
+            options.budget = budget;
+            if (device) {
+                options.maxThreads = device->policy.threadsPerItem;
+                options.initialThreads = deviceTuning.Lookup(device->device.key);
             }
+            DeleteEngine engine(options);
+            result = engine.DeleteFolderContents(folderPath, itemName);
             
-            auto deleteStart = std::chrono::high_resolution_clock::now();
-            for (auto& thread : deleteThreads) {
-                if (thread.joinable()) {
-                    thread.join();
-                }
-                
-                auto elapsed = std::chrono::high_resolution_clock::now() - deleteStart;
-                if (std::chrono::duration_cast<std::chrono::seconds>(elapsed).count() > 30) {
-                    for (auto& remainingThread : deleteThreads) {
-                        if (remainingThread.joinable()) {
-                            remainingThread.detach();
-                        }
-                    }
-                    break;
+            // A dry run only stats, its rate says nothing about unlinks.
+            if (device && !dryRunMode && engine.Concurrency()) {
+                deviceTuning.Remember(device->device.key, engine.Concurrency());
+                if (verboseMode) {
+                    AppendToResults("⚙️ " + itemName + " - settled on " + std::to_string(engine.Concurrency()) +
+                                   " workers for " + device->device.name);
                 }
             }
-            
-            result.filesDeleted = deleted.load();
-            result.filesSkipped = skipped.load();
-            
         } catch (const std::exception& e) {
             result.success = false;
             result.errorMessage = e.what();
             AppendToResults("Exception in deleteFolderContents: " + std::string(e.what()));
         }
         
-        uintmax_t sizeAfter = GetFolderSize(folderPath);
-        result.bytesRemoved = sizeBefore - sizeAfter;
-        
-        AppendToResults(itemName + " - Deleted: " + std::to_string(result.filesDeleted) + 
-                       " items, Skipped: " + std::to_string(result.filesSkipped) + " items");
+        if (!dryRunMode) {
+            AppendToResults(itemName + " - Deleted: " + std::to_string(result.filesDeleted) + 
+                           " items, Skipped: " + std::to_string(result.filesSkipped) + " items" +
+                           (result.filesKept ? ", Kept: " + std::to_string(result.filesKept) : std::string()));
+        }
         
         auto endTime = std::chrono::high_resolution_clock::now();
         result.duration = std::chrono::duration_cast<std::chrono::milliseconds>(endTime - startTime);
@@ -1087,6 +1373,19 @@ private:
         return result;
     }
 
+    // Optional include/exclude rules for every cleanup target, see DiskCleanerFilter.h.
+    void LoadCleanupFilter() {
+        std::error_code ec;
+        if (!fs::exists("cleanup_filters.txt", ec)) return;
+        std::string error;
+        if (!cleanupFilter.LoadRules("cleanup_filters.txt", error)) {
+            AppendToResults("❌ Filter rules ignored: " + error);
+            return;
+        }
+        AppendToResults("🔎 Filter: " + std::to_string(cleanupFilter.IncludeCount()) + " include and " +
+                       std::to_string(cleanupFilter.ExcludeCount()) + " exclude rules from cleanup_filters.txt");
+    }
+
     void EmptyRecycleBin() {
         if (dryRunMode) {
             AppendToResults("[DRY RUN] Would empty Recycle Bin");
@@ -1128,9 +1427,12 @@ private:
         for (const auto& item : selectedItems) {
             if (IsDirectoryEmptyOrInaccessible(item.path)) {
                 AppendToResults(item.name + " - Skipped (empty or inaccessible)");
+            } else if (freeBudgetBytes && item.path == "RECYCLE_BIN") {
+                AppendToResults(item.name + " - Skipped (emptied as a whole, not by age)");
             } else {
                 validItems.push_back(item);
-                AppendToResults(item.name + " - Ready for cleanup");
+                AppendToResults(item.name + " - Ready for cleanup" +
+                               (item.retention.Active() ? " (retention " + item.retention.ToString() + ")" : std::string()));
             }
         }
         
@@ -1153,6 +1455,10 @@ private:
         std::wstring confirmMsg = L"About to clean " + std::to_wstring(selectedItems.size()) + 
                                  L" locations (" + StringToWString(FormatBytes(totalSelectedSize)) + L").\n\n";
         
+        if (freeBudgetBytes) {
+            confirmMsg += L"Only the oldest files are deleted, until " +
+                          StringToWString(FormatBytes(freeBudgetBytes)) + L" are freed.\n\n";
+        }
         if (!dryRunMode) {
             confirmMsg += L"WARNING: This will permanently delete files!\n\n";
         }
@@ -1166,128 +1472,123 @@ private:
         isCleanupRunning = true;
         EnableWindow(hwndBtnCleanup, FALSE);
         EnableWindow(hwndBtnRefresh, FALSE);
+        cleanupControl.Reset();
+        EnableCleanupMenu(true);
         
-        SetWindowText(hwndResults, L"");
+        ClearResults();
 
         completedTasks = 0;
         totalTasks = static_cast<int>(selectedItems.size());
         SendMessage(hwndProgressOverall, PBM_SETRANGE, 0, MAKELPARAM(0, 100));
         SendMessage(hwndProgressOverall, PBM_SETPOS, 0, 0);
 
+        VolumeSpaceTracker volumeTracker;
+        if (!dryRunMode) {
+            std::vector<std::string> itemPaths;
+            for (const auto& item : selectedItems) {
+                itemPaths.push_back(item.path);
+            }
+            volumeTracker.Capture(itemPaths);
+        }
+
         auto startTime = std::chrono::high_resolution_clock::now();
         
-        const unsigned int numThreads = std::thread::hardware_concurrency();
-        const unsigned int maxConcurrent = (std::min)(static_cast<unsigned int>(selectedItems.size()), numThreads);
+        TaskScheduler& scheduler = TaskScheduler::Shared();
+        SchedulerStats statsBefore = scheduler.Stats();
         
         AppendToResults("🚀 DiskCleaner " + GetVersionString() + " TURBO - Ultra-fast parallel cleanup");
-        AppendToResults("⚡ Maximum performance mode : " + std::to_string(maxConcurrent) + " threads + detached execution");
+        AppendToResults("⚡ Maximum performance mode : " + std::to_string(scheduler.Workers()) + " shared worker threads");
         AppendToResults("🛡️ Administrator privileges active - all system locations accessible");
         AppendToResults("📊 Total tasks to process : " + std::to_string(totalTasks.load()));
         
         std::vector<CleanupResult> results;
-        std::atomic<int> completedCount{0};
-        
-        AppendToResults("Processing ALL " + std::to_string(selectedItems.size()) + " tasks in parallel for maximum speed!");
         
-        std::vector<std::shared_ptr<bool>> taskDoneFlags(selectedItems.size());
-        std::vector<std::shared_ptr<CleanupResult>> taskResults(selectedItems.size());
-        std::vector<std::shared_ptr<std::mutex>> taskMutexes(selectedItems.size());
-        
-        for (size_t i = 0; i < selectedItems.size(); ++i) {
-            taskDoneFlags[i] = std::make_shared<bool>(false);
-            taskResults[i] = std::make_shared<CleanupResult>();
-            taskMutexes[i] = std::make_shared<std::mutex>();
+        std::vector<std::string> itemPaths;
+        for (const auto& item : selectedItems) {
+            itemPaths.push_back(item.path);
+        }
+        std::vector<DeviceGroup> deviceGroups = GroupByDevice(itemPaths);
+        for (const auto& group : deviceGroups) {
+            if (group.device.key.empty()) continue;
+            AppendToResults("💽 " + group.device.name + " (" + DeviceKindText(group.device.kind) + "): " +
+                           std::to_string(group.items.size()) + " items, " +
+                           (group.policy.itemsAtOnce ? std::to_string(group.policy.itemsAtOnce) + " at a time"
+                                                     : std::string("all in parallel")));
         }
         
-        AppendToResults("⚡ Launching " + std::to_string(selectedItems.size()) + " parallel cleanup threads...");
-        for (size_t i = 0; i < selectedItems.size(); ++i) {
-            const auto& item = selectedItems[i];
-            auto taskDone = taskDoneFlags[i];
-            auto taskResult = taskResults[i];
-            auto taskMutex = taskMutexes[i];
-            
-            std::thread([this, item, taskDone, taskResult, taskMutex]() {
-                try {
-                    CleanupResult result = DeleteFolderContentsParallel(item.path, item.name);
-                    std::lock_guard<std::mutex> lock(*taskMutex);
-                    *taskResult = result;
-                    *taskDone = true;
-                } catch (const std::exception& e) {
-                    std::lock_guard<std::mutex> lock(*taskMutex);
-                    taskResult->itemName = item.name;
-                    taskResult->success = false;
-                    taskResult->errorMessage = "Exception: " + std::string(e.what());
-                    taskResult->bytesRemoved = 0;
-                    taskResult->filesDeleted = 0;
-                    taskResult->filesSkipped = 0;
-                    *taskDone = true;
-                } catch (...) {
-                    std::lock_guard<std::mutex> lock(*taskMutex);
-                    taskResult->itemName = item.name;
-                    taskResult->success = false;
-                    taskResult->errorMessage = "Unknown exception";
-                    taskResult->bytesRemoved = 0;
-                    taskResult->filesDeleted = 0;
-                    taskResult->filesSkipped = 0;
-                    *taskDone = true;
-                }
-            }).detach();
+        // A budget needs the age histogram of every item before the first file goes.
+        std::unique_ptr<FreeSpaceBudget> budget;
+        if (freeBudgetBytes) {
+            budget = std::make_unique<FreeSpaceBudget>(freeBudgetBytes);
+            AppendToResults("🎯 Surveying file ages to free " + FormatBytes(freeBudgetBytes) + ", oldest first...");
+            WalkOptions walkOptions;
+            walkOptions.scheduler = &scheduler;
+            walkOptions.cancel = &cleanupControl;
+            for (const auto& item : selectedItems) {
+                SurveyFreeSpace(*budget, item.path, walkOptions, &cleanupFilter, item.retention);
+            }
+            budget->Plan();
+            if (budget->Boundary() == std::numeric_limits<int64_t>::max()) {
+                AppendToResults("🎯 All " + FormatBytes(budget->SurveyedBytes()) + " surveyed fit the budget");
+            } else {
+                int64_t days = (RetentionNow() - budget->Boundary()) / (86400LL * 1000000000);
+                AppendToResults("🎯 " + FormatBytes(budget->OlderBytes()) + " last written over " + std::to_string(days) +
+                               " days ago go first, then files of that hour (" + std::to_string(budget->Buckets()) +
+                               " hours surveyed, " + FormatBytes(budget->SurveyedBytes()) + ")");
+            }
         }
         
-        AppendToResults("⚡ All tasks launched! Monitoring completion...");
+        CompletionQueue<CleanupResult> completions;
         
-        std::vector<bool> taskCompleted(selectedItems.size(), false);
-        auto monitoringStartTime = std::chrono::high_resolution_clock::now();
+        bool tracing = traceCleanup;
+        if (tracing) Tracer::Global().Start();
         
-        while (completedCount.load() < static_cast<int>(selectedItems.size())) {
-            bool anyProgress = false;
-            
-            for (size_t i = 0; i < selectedItems.size(); ++i) {
-                if (taskCompleted[i]) continue;
-                
-                {
-                    std::lock_guard<std::mutex> lock(*taskMutexes[i]);
-                    if (*taskDoneFlags[i]) {
-                        results.push_back(*taskResults[i]);
-                        completedCount++;
-                        taskCompleted[i] = true;
-                        anyProgress = true;
-                        
-                        if (verboseMode) {
-                            AppendToResults("✅ " + taskResults[i]->itemName + " (" + std::to_string(completedCount.load()) + "/" + std::to_string(totalTasks.load()) + ")");
-                        }
-                        UpdateProgress(completedCount.load(), totalTasks.load());
-                    }
-                }
+        AppendToResults("⚡ Queueing " + std::to_string(selectedItems.size()) + " cleanup tasks across " +
+                       std::to_string(deviceGroups.size()) + " devices...");
+        auto progress = BeginProgress(dryRunMode ? "Dry run" : "Cleaning", totalSelectedSize, selectedItems.size());
+        TaskGroup cleanupTasks(scheduler);
+        RunPerDevice(cleanupTasks, deviceGroups,
+                     [this, &selectedItems, &completions, &progress, &budget](size_t i, const DeviceGroup& group) {
+            const auto& item = selectedItems[i];
+            CleanupResult result{item.name, 0, 0, 0, false, "", std::chrono::milliseconds(0), 0};
+
+            try {
+                // With time limits on, the item's limit starts when its device lets it run.
+                CancellationToken itemControl(&cleanupControl);
+                if (itemTimeLimits) itemControl.SetTimeout(std::chrono::seconds(CLEANUP_ITEM_TIME_LIMIT_SEC));
+                result = DeleteFolderContentsParallel(item.path, item.name, &itemControl, &group,
+                                                      progress->counters.get(), item.retention, budget.get());
+            } catch (const std::exception& e) {
+                result.errorMessage = "Exception: " + std::string(e.what());
+            } catch (...) {
+                result.errorMessage = "Unknown exception";
             }
+            progress->counters->ItemDone();
+            completions.Push(std::move(result));
+        });
+        
+        AppendToResults("⚡ All tasks launched! Monitoring completion...");
+        
+        // Every task finishes on its own: items stop when done, at their time limit if one
+        // is enabled, or when the run is cancelled, and report what they removed up to that
+        // point. Each result is handled as soon as it is pushed; in between this thread
+        // sleeps.
+        while (results.size() < selectedItems.size()) {
+            CleanupResult result;
+            completions.Pop(result);
+            results.push_back(result);
             
-            auto currentTime = std::chrono::high_resolution_clock::now();
-            auto elapsed = std::chrono::duration_cast<std::chrono::seconds>(currentTime - monitoringStartTime);
-            
-            if (elapsed.count() > 15) {
-                for (size_t i = 0; i < selectedItems.size(); ++i) {
-                    if (!taskCompleted[i]) {
-                        AppendToResults("⚠️ TIMEOUT: " + selectedItems[i].name + " (thread continues in background)");
-                        
-                        CleanupResult timeoutResult;
-                        timeoutResult.itemName = selectedItems[i].name;
-                        timeoutResult.success = false;
-                        timeoutResult.errorMessage = "Timeout";
-                        timeoutResult.bytesRemoved = 0;
-                        timeoutResult.filesDeleted = 0;
-                        timeoutResult.filesSkipped = 0;
-                        results.push_back(timeoutResult);
-                        
-                        taskCompleted[i] = true;
-                        completedCount++;
-                        UpdateProgress(completedCount.load(), totalTasks.load());
-                    }
-                }
-                break;
+            if (result.errorMessage == StopReasonText(StopReason::Cancelled) ||
+                result.errorMessage == StopReasonText(StopReason::DeadlineExceeded)) {
+                AppendToResults("⚠️ " + result.itemName + " - " + result.errorMessage +
+                               ", stopped after " + std::to_string(result.filesDeleted) + " items (" +
+                               FormatBytes(result.bytesRemoved) + ")");
+            } else if (verboseMode) {
+                AppendToResults("✅ " + result.itemName + " (" + std::to_string(results.size()) + "/" + std::to_string(totalTasks.load()) + ")");
             }
-            
-            std::this_thread::sleep_for(std::chrono::milliseconds(100));
         }
+        EndProgress(progress);
+        if (tracing) Tracer::Global().Stop();
 
         auto endTime = std::chrono::high_resolution_clock::now();
         auto totalDuration = std::chrono::duration_cast<std::chrono::seconds>(endTime - startTime);
@@ -1307,11 +1608,63 @@ private:
         AppendToResults("");
         AppendToResults("=== Cleanup Summary ===");
         AppendToResults("Total space " + std::string(dryRunMode ? "that would be " : "") + "freed: " + FormatBytes(totalRemoved));
+        if (budget) {
+            AppendToResults("Budget: " + FormatBytes(budget->Admitted()) + " of " + FormatBytes(budget->Target()) +
+                           (budget->Met() ? " reached" : " (not enough old files)"));
+        }
         AppendToResults("Files deleted: " + std::to_string(totalFilesDeleted));
         AppendToResults("Files skipped: " + std::to_string(totalFilesSkipped));
         AppendToResults("Successful operations: " + std::to_string(successfulOperations) + "/" + std::to_string(results.size()));
         AppendToResults("Total time: " + std::to_string(totalDuration.count()) + " seconds");
         
+        if (!dryRunMode) {
+            std::map<std::string, std::string> itemPaths;
+            for (const auto& item : selectedItems) {
+                itemPaths[item.name] = item.path;
+            }
+            for (const auto& result : results) {
+                auto it = itemPaths.find(result.itemName);
+                if (it != itemPaths.end()) {
+                    volumeTracker.AddAccounted(it->second, result.bytesRemoved);
+                }
+            }
+            
+            for (const auto& delta : volumeTracker.Finish()) {
+                std::string change = delta.availableAfter >= delta.availableBefore
+                    ? "+" + FormatBytes(delta.availableAfter - delta.availableBefore)
+                    : "-" + FormatBytes(delta.availableBefore - delta.availableAfter);
+                AppendToResults("Volume " + delta.volume + " free space: " + change + 
+                               " (accounted " + FormatBytes(delta.bytesAccounted) + ")");
+            }
+        }
+        
+        SchedulerStats statsAfter = scheduler.Stats();
+        double busy = statsAfter.busySeconds - statsBefore.busySeconds;
+        double wall = statsAfter.elapsedSeconds - statsBefore.elapsedSeconds;
+        {
+            std::ostringstream oss;
+            oss << "Scheduler: " << statsAfter.tasksRun - statsBefore.tasksRun << " tasks on " << statsAfter.workers
+                << " workers, utilization " << std::fixed << std::setprecision(0)
+                << (wall > 0 ? 100.0 * busy / (statsAfter.workers * wall) : 0.0) << "%, peak queue depth "
+                << statsAfter.peakQueued;
+            AppendToResults(oss.str());
+        }
+        
+        if (tracing) {
+            // Task spans and queue wait come from the shared scheduler, so anything else
+            // running on it meanwhile (live sizes) shows up in the trace too.
+            for (const auto& line : Tracer::Global().SummaryLines()) {
+                AppendToResults("⏱️ " + line);
+            }
+            uint64_t dropped = Tracer::Global().DroppedEvents();
+            if (dropped) {
+                AppendToResults("⏱️ " + std::to_string(dropped) + " events beyond the per-thread cap kept in the histograms only");
+            }
+            AppendToResults(Tracer::Global().WriteChromeTrace("diskcleaner_trace.json")
+                                ? "⏱️ Trace written to diskcleaner_trace.json (open in ui.perfetto.dev or chrome://tracing)"
+                                : "❌ Could not write diskcleaner_trace.json");
+        }
+        
         if (!results.empty()) {
             auto avgTimePerTask = totalDuration.count() / static_cast<double>(results.size());
             std::ostringstream oss;
@@ -1322,11 +1675,179 @@ private:
         isCleanupRunning = false;
         EnableWindow(hwndBtnCleanup, TRUE);
         EnableWindow(hwndBtnRefresh, TRUE);
-        SetStatusText("Cleanup completed.");
+        EnableCleanupMenu(false);
+        if (!dryRunMode) {
+            deviceTuning.Save("device_tuning.txt");
+        }
+        SetStatusText(cleanupControl.Reason() == StopReason::Cancelled ? "Cleanup cancelled." : "Cleanup completed.");
         
         std::thread([this]() { CalculateSizesAsync(); }).detach();
     }
 
+    // File > Find Duplicates: one search across all checked locations, since copies are
+    // usually spread over several of them. Only reports until the user picks what to do
+    // with the copies; Cleanup > Cancel stops the search.
+    void FindDuplicates() {
+        std::vector<std::string> roots;
+        for (const auto& item : cleanupItems) {
+            if (item.enabled && item.path != "RECYCLE_BIN" && !IsDirectoryEmptyOrInaccessible(item.path)) {
+                roots.push_back(item.path);
+            }
+        }
+        if (roots.empty()) {
+            MessageBox(hwndMain, L"No locations selected to search for duplicates.", L"Warning", MB_OK | MB_ICONWARNING);
+            return;
+        }
+
+        isCleanupRunning = true;
+        EnableWindow(hwndBtnCleanup, FALSE);
+        EnableWindow(hwndBtnRefresh, FALSE);
+        cleanupControl.Reset();
+        EnableCleanupMenu(true);
+        ClearResults();
+        SetStatusText("Searching for duplicates...");
+        AppendToResults("🔍 Searching " + std::to_string(roots.size()) + " locations for duplicate files...");
+
+        DuplicateOptions options;
+        options.scheduler = &TaskScheduler::Shared();
+        options.cancel = &cleanupControl;
+        DuplicateFinder finder(options);
+        std::vector<DuplicateGroup> groups = finder.Find(roots);
+        const DuplicateStats& stats = finder.Stats();
+
+        if (stats.stopped) {
+            AppendToResults("⚠️ Duplicate search " + std::string(StopReasonText(cleanupControl.Reason())));
+        } else {
+            AppendToResults("🔍 " + std::to_string(stats.files) + " files, " + std::to_string(stats.sizeCandidates) +
+                           " share their size, " + std::to_string(stats.edgeCandidates) +
+                           " also their first and last 4 KB; " + FormatBytes(stats.edgeBytesRead + stats.fullBytesRead) + " read");
+            for (size_t i = 0; i < groups.size() && i < DUPLICATE_GROUPS_SHOWN; ++i) {
+                const auto& group = groups[i];
+                AppendToResults("📑 " + FormatBytes(group.Reclaimable()) + " - " + std::to_string(group.paths.size()) +
+                               " copies of " + group.paths.front() + " (" + FormatBytes(group.size) + " each)");
+                if (verboseMode) {
+                    for (size_t j = 1; j < group.paths.size(); ++j) AppendToResults("      " + group.paths[j]);
+                }
+            }
+            if (groups.size() > DUPLICATE_GROUPS_SHOWN) {
+                AppendToResults("... and " + std::to_string(groups.size() - DUPLICATE_GROUPS_SHOWN) + " more groups");
+            }
+            AppendToResults("Reclaimable: " + FormatBytes(stats.reclaimableBytes) + " in " +
+                           std::to_string(stats.duplicateFiles) + " duplicate files");
+        }
+
+        bool changed = false;
+        if (!groups.empty()) {
+            std::wstring prompt = L"Found " + std::to_wstring(stats.duplicateFiles) + L" duplicate files (" +
+                                  StringToWString(FormatBytes(stats.reclaimableBytes)) + L" reclaimable).\n\n"
+                                  L"Yes: replace the copies with hard links to the first file\n"
+                                  L"No: delete the copies\n"
+                                  L"Cancel: keep everything";
+            if (dryRunMode) prompt += L"\n\n(Dry run: nothing is changed.)";
+            int answer = MessageBox(hwndMain, prompt.c_str(), L"Duplicates", MB_YESNOCANCEL | MB_ICONQUESTION);
+            if (answer == IDYES || answer == IDNO) {
+                DuplicateAction action = answer == IDYES ? DuplicateAction::HardLink : DuplicateAction::Delete;
+                uintmax_t freed = 0;
+                size_t replaced = 0, failed = 0;
+                for (const auto& group : groups) {
+                    DuplicateActionResult result = ApplyDuplicateAction(group, action, dryRunMode);
+                    freed += result.bytesFreed;
+                    replaced += result.replaced;
+                    failed += result.failed;
+                    for (const auto& error : result.errors) {
+                        if (verboseMode) AppendToResults("❌ " + error);
+                    }
+                }
+                changed = replaced && !dryRunMode;
+                AppendToResults(std::string(action == DuplicateAction::HardLink ? "🔗 Hard-linked " : "🗑️ Deleted ") +
+                               std::to_string(replaced) + " copies, " + FormatBytes(freed) + " " +
+                               (dryRunMode ? "would be " : "") + "freed" +
+                               (failed ? ", " + std::to_string(failed) + " left alone (changed or failed)" : std::string()));
+            }
+        }
+
+        isCleanupRunning = false;
+        EnableWindow(hwndBtnCleanup, TRUE);
+        EnableWindow(hwndBtnRefresh, TRUE);
+        EnableCleanupMenu(false);
+        SetStatusText(stats.stopped ? "Duplicate search stopped." : "Duplicate search completed.");
+        if (changed) {
+            std::thread([this]() { CalculateSizesAsync(); }).detach();
+        }
+    }
+
+    // File > Show Largest Files: what makes up the totals in the list. One sizing walk per
+    // checked location keeps its largest files and directories; the results are logged
+    // per location (all of them with Verbose) and across all of them.
+    void ShowLargest() {
+        std::vector<const CleanupItem*> items;
+        for (const auto& item : cleanupItems) {
+            if (item.enabled && item.path != "RECYCLE_BIN") items.push_back(&item);
+        }
+        if (items.empty()) {
+            MessageBox(hwndMain, L"No locations selected.", L"Warning", MB_OK | MB_ICONWARNING);
+            return;
+        }
+
+        isCleanupRunning = true;
+        EnableWindow(hwndBtnCleanup, FALSE);
+        EnableWindow(hwndBtnRefresh, FALSE);
+        cleanupControl.Reset();
+        EnableCleanupMenu(true);
+        ClearResults();
+        SetStatusText("Finding largest files...");
+
+        auto progress = BeginProgress("Finding largest files", 0, items.size());
+        std::vector<LargestEntries> results;
+        for (const auto* item : items) {
+            if (cleanupControl.StopRequested()) break;
+            CancellationToken itemControl(&cleanupControl);
+            if (itemTimeLimits) itemControl.SetTimeout(std::chrono::seconds(SIZE_ITEM_TIME_LIMIT_SEC));
+            WalkOptions walkOptions;
+            walkOptions.scheduler = &TaskScheduler::Shared();
+            walkOptions.cancel = &itemControl;
+            results.push_back(FindLargest(item->path, LARGEST_SHOWN, walkOptions));
+            const LargestEntries& largest = results.back();
+            progress->counters->ItemDone();
+
+            std::string line = "📦 " + item->name + ": " + FormatBytes(largest.totals.bytes);
+            if (!largest.files.empty()) {
+                line += ", largest file " + FormatBytes(largest.files.front().bytes) + " " + largest.files.front().path;
+            }
+            if (largest.totals.stopped) line += " (" + std::string(StopReasonText(itemControl.Reason())) + ", partial)";
+            AppendToResults(line);
+            if (verboseMode) {
+                for (const auto& entry : largest.files) AppendToResults("      " + FormatBytes(entry.bytes) + "  " + entry.path);
+                for (const auto& entry : largest.directories) {
+                    AppendToResults("      " + FormatBytes(entry.bytes) + "  " + entry.path + "\\");
+                }
+            }
+        }
+        EndProgress(progress);
+
+        std::vector<const std::vector<SizedPath>*> files, directories;
+        for (const auto& largest : results) {
+            files.push_back(&largest.files);
+            directories.push_back(&largest.directories);
+        }
+        AppendToResults("");
+        AppendToResults("=== Largest Files ===");
+        for (const auto& entry : MergeLargest(files, LARGEST_SHOWN)) {
+            AppendToResults(FormatBytes(entry.bytes) + "  " + entry.path);
+        }
+        AppendToResults("");
+        AppendToResults("=== Heaviest Directories (files directly inside) ===");
+        for (const auto& entry : MergeLargest(directories, LARGEST_SHOWN)) {
+            AppendToResults(FormatBytes(entry.bytes) + "  " + entry.path);
+        }
+
+        isCleanupRunning = false;
+        EnableWindow(hwndBtnCleanup, TRUE);
+        EnableWindow(hwndBtnRefresh, TRUE);
+        EnableCleanupMenu(false);
+        SetStatusText(cleanupControl.Reason() == StopReason::Cancelled ? "Search cancelled." : "Largest files listed.");
+    }
+
 public:
     bool Initialize(HINSTANCE hInstance) {
         WNDCLASSEX wc = {};
@@ -0,0 +1,132 @@
+#pragma once
+
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <limits>
+#include <cstdint>
+
+// =====================================================================================
+// FREE-SPACE BUDGET
+// =====================================================================================
+// "Free 50 GB, oldest first across all selected targets" instead of emptying them. Two
+// passes, with memory that does not grow with the number of files:
+//   1. Survey: a sizing walk over every target (SurveyFreeSpace in DiskCleanerWalker.h)
+//      adds the size of each file the delete pass would offer, after the same filter
+//      and retention policy, to a histogram of last-write times in one-hour buckets.
+//      Every link of a file counts, as the delete pass unlinks and charges each.
+//      Summing the oldest buckets until they reach the budget gives a boundary hour:
+//      everything older goes, everything newer stays.
+//   2. Delete: the delete engine asks Admit() for every file. Files older than the
+//      boundary are admitted, files of the boundary hour only while its share of the
+//      budget lasts (in listing order), and once the budget is met the engine stops.
+// The histogram holds one entry per hour that has files, a few thousand for years of
+// data, whether the targets hold a thousand files or fifty million.
+//
+// A file that fails to delete gives its bytes back (Refund), so files listed after it
+// can make up for it; once the budget was met and listing stopped, nothing does, and a
+// run can free somewhat less than asked.
+// =====================================================================================
+
+struct BudgetBucket {
+    uint64_t bytes = 0;
+    uint64_t files = 0;
+};
+
+class FreeSpaceBudget {
+public:
+    static constexpr int64_t BucketNanos = 3600LL * 1000000000;
+
+    explicit FreeSpaceBudget(uint64_t targetBytes) : target(targetBytes) {}
+
+    FreeSpaceBudget(const FreeSpaceBudget&) = delete;
+    FreeSpaceBudget& operator=(const FreeSpaceBudget&) = delete;
+
+    // Hour of a last write time in RetentionNow() units, rounded down also before 1970.
+    static int64_t BucketOf(int64_t mtime) {
+        return mtime >= 0 ? mtime / BucketNanos : -((-mtime + BucketNanos - 1) / BucketNanos);
+    }
+
+    // Merges one walk's histogram; safe to call from several surveys at once.
+    void AddSurvey(const std::map<int64_t, BudgetBucket>& buckets) {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (const auto& [bucket, counts] : buckets) {
+            histogram[bucket].bytes += counts.bytes;
+            histogram[bucket].files += counts.files;
+        }
+    }
+
+    // Fixes the boundary from everything surveyed. Call once, before the delete pass.
+    void Plan() {
+        std::lock_guard<std::mutex> lock(mutex);
+        surveyed = 0;
+        for (const auto& entry : histogram) surveyed += entry.second.bytes;
+
+        uint64_t older = 0;
+        boundaryStart = std::numeric_limits<int64_t>::max();
+        boundaryEnd = boundaryStart;
+        boundaryAllowance = 0;
+        for (const auto& [bucket, counts] : histogram) {
+            if (older + counts.bytes >= target) {
+                boundaryStart = bucket * BucketNanos;
+                boundaryEnd = boundaryStart + BucketNanos;
+                boundaryAllowance = target - older;
+                break;
+            }
+            older += counts.bytes;
+        }
+        olderBytes = older;
+    }
+
+    // Whether a file goes. Thread-safe; counts its size against the budget when it does.
+    bool Admit(int64_t mtime, uintmax_t size) {
+        if (mtime < boundaryStart) {
+            olderClaimed.fetch_add(size, std::memory_order_relaxed);
+            return true;
+        }
+        if (mtime >= boundaryEnd) return false;
+        uint64_t used = boundaryClaimed.load(std::memory_order_relaxed);
+        do {
+            if (used >= boundaryAllowance) return false;
+        } while (!boundaryClaimed.compare_exchange_weak(used, used + size, std::memory_order_relaxed));
+        return true;
+    }
+
+    // Takes back what Admit() counted for a file that then could not be removed.
+    void Refund(int64_t mtime, uintmax_t size) {
+        if (mtime < boundaryStart) {
+            olderClaimed.fetch_sub(size, std::memory_order_relaxed);
+        } else {
+            boundaryClaimed.fetch_sub(size, std::memory_order_relaxed);
+        }
+    }
+
+    bool Met() const { return Admitted() >= target; }
+
+    uint64_t Target() const { return target; }
+    uint64_t Admitted() const {
+        return olderClaimed.load(std::memory_order_relaxed) + boundaryClaimed.load(std::memory_order_relaxed);
+    }
+    uint64_t SurveyedBytes() const { return surveyed; }
+    // Bytes of the files older than the boundary hour, all of which go.
+    uint64_t OlderBytes() const { return olderBytes; }
+    // Start of the boundary hour in RetentionNow() units; max when everything surveyed goes.
+    int64_t Boundary() const { return boundaryStart; }
+    size_t Buckets() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return histogram.size();
+    }
+
+private:
+    const uint64_t target;
+    mutable std::mutex mutex;
+    std::map<int64_t, BudgetBucket> histogram;
+    uint64_t surveyed = 0;
+    uint64_t olderBytes = 0;
+    // Nothing is admitted before Plan().
+    int64_t boundaryStart = std::numeric_limits<int64_t>::min();
+    int64_t boundaryEnd = std::numeric_limits<int64_t>::min();
+    uint64_t boundaryAllowance = 0;
+    std::atomic<uint64_t> olderClaimed{0};
+    std::atomic<uint64_t> boundaryClaimed{0};
+};
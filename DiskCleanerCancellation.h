@@ -0,0 +1,139 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <condition_variable>
+
+// =====================================================================================
+// CANCELLATION
+// =====================================================================================
+// A CancellationToken is handed to the walker and the delete engine, which call
+// Checkpoint() once per directory and every few hundred entries inside one. Checkpoint
+// returns false once the token (or a parent token) is cancelled or past its deadline,
+// and blocks for as long as either is paused. Work stops at the next checkpoint and
+// the engines report what they actually did up to there.
+//
+// Tokens chain: one per run (cancel/pause from the UI) as the parent of one per item
+// (that item's deadline). A deadline only counts running time: while a token or any of
+// its parents is paused the deadline moves back with the clock, so a long pause does not
+// expire every item the moment it is resumed. (A token paused together with its parent
+// has that time counted twice, which only makes its deadline more lenient.)
+// =====================================================================================
+
+enum class StopReason {
+    None,
+    Cancelled,
+    DeadlineExceeded
+};
+
+class CancellationToken {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    explicit CancellationToken(const CancellationToken* parent = nullptr) : parent(parent) {}
+
+    CancellationToken(const CancellationToken&) = delete;
+    CancellationToken& operator=(const CancellationToken&) = delete;
+
+    void Cancel() {
+        cancelled = true;
+        Notify();
+    }
+
+    void Pause() {
+        if (paused) return;
+        pausedSince = Now();
+        paused = true;
+    }
+
+    void Resume() {
+        if (!paused) return;
+        // Total first, then clear the start: a reader that sees the cleared start sees
+        // the new total (see PausedTicks).
+        pausedTotal += Now() - pausedSince;
+        pausedSince = 0;
+        paused = false;
+        Notify();
+    }
+
+    void SetDeadline(Clock::time_point when) {
+        deadlinePausedBase = PausedTicks();
+        deadline = when.time_since_epoch().count();
+        Notify();
+    }
+
+    void SetTimeout(Clock::duration timeout) {
+        SetDeadline(Clock::now() + timeout);
+    }
+
+    // Back to a fresh token for the next run; only while nothing is using it.
+    void Reset() {
+        cancelled = false;
+        paused = false;
+        pausedSince = 0;
+        pausedTotal = 0;
+        deadline = NoDeadline;
+        deadlinePausedBase = 0;
+    }
+
+    bool IsPaused() const {
+        return paused || (parent && parent->IsPaused());
+    }
+
+    StopReason Reason() const {
+        if (cancelled) return StopReason::Cancelled;
+        Clock::rep until = deadline;
+        if (until != NoDeadline && Now() >= until + (PausedTicks() - deadlinePausedBase)) return StopReason::DeadlineExceeded;
+        return parent ? parent->Reason() : StopReason::None;
+    }
+
+    bool StopRequested() const { return Reason() != StopReason::None; }
+
+    // False when the caller should stop. Blocks while paused.
+    bool Checkpoint() const {
+        while (IsPaused()) {
+            if (StopRequested()) return false;
+            // Short waits: a parent's Resume() notifies the parent, not this token.
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait_for(lock, std::chrono::milliseconds(50));
+        }
+        return !StopRequested();
+    }
+
+private:
+    static constexpr Clock::rep NoDeadline = 0;
+
+    static Clock::rep Now() { return Clock::now().time_since_epoch().count(); }
+
+    // Clock ticks this token and its parents have spent paused so far, including a pause
+    // still in progress.
+    Clock::rep PausedTicks() const {
+        Clock::rep since = pausedSince;
+        Clock::rep total = pausedTotal + (since ? Now() - since : 0);
+        return total + (parent ? parent->PausedTicks() : 0);
+    }
+
+    void Notify() {
+        std::lock_guard<std::mutex> lock(mutex);
+        wake.notify_all();
+    }
+
+    const CancellationToken* parent;
+    std::atomic<bool> cancelled{false};
+    std::atomic<bool> paused{false};
+    std::atomic<Clock::rep> deadline{NoDeadline};
+    std::atomic<Clock::rep> deadlinePausedBase{0};  // PausedTicks() when the deadline was set
+    std::atomic<Clock::rep> pausedSince{0};          // 0 while running
+    std::atomic<Clock::rep> pausedTotal{0};
+    mutable std::mutex mutex;
+    mutable std::condition_variable wake;
+};
+
+inline const char* StopReasonText(StopReason reason) {
+    switch (reason) {
+        case StopReason::Cancelled: return "Cancelled";
+        case StopReason::DeadlineExceeded: return "Time limit reached";
+        default: return "";
+    }
+}
@@ -0,0 +1,672 @@
+// Command-line front end for the cleanup engine, for scripts and build agents. Sizes or
+// cleans the given roots and prints one JSON object per line (NDJSON) as each root
+// finishes, then a summary line; --json prints a single document at the end instead.
+//
+//   g++ -std=c++17 -O2 -pthread DiskCleanerCli.cpp -o DiskCleanerCli
+//   ./DiskCleanerCli size /var/tmp ~/.cache
+//   ./DiskCleanerCli clean --dry-run --threads 8 ~/.cache/thumbnails /tmp/build-*
+//
+// Every root reports per phase: "scan" (parallel walk, the same as the GUI's sizing)
+// and, for clean, "delete" (the adaptive delete engine) with bytes, files, seconds and
+// throughput. --trace FILE records per-phase latencies (enumerate, stat, unlink, rmdir,
+// queue wait), adds their p50/p99 to the summary and writes a Chrome trace to FILE.
+// --include/--exclude PATTERN (repeatable) and --filters FILE limit what clean removes;
+// "scan" still sizes everything, the delete phase (or a --dry-run) shows what matched and
+// "kept" counts what the rules left in place. --retain SPEC ("days=30,keep=10,size=2GB")
+// keeps recent files of every directory and removes no directories. --free SIZE ("50GB")
+// deletes only the oldest files across all roots until SIZE is freed: every root is
+// surveyed first (its "scan" phase), then cleaned against the shared budget. --timeout
+// bounds each survey; a root whose survey stops fails and is left alone.
+//
+// "dupes" finds files with equal contents across all roots (by size, then the hash of
+// their first and last 4 KB, then a full hash) and prints one line per group with the
+// bytes that keeping one copy would free. --min-size SIZE skips small files; --action
+// delete|hardlink|reflink then applies that to every copy but the first (after a
+// byte-for-byte check), or only reports what it would free with --dry-run.
+//
+// "top" lists the --top K (default 20) largest files and heaviest directories of every
+// root, found during its scan, and across all roots in the summary.
+//
+// "size --index FILE" sizes through a per-directory index and writes the resulting tree
+// as a usage index to FILE; "du --index FILE PATH..." then answers from FILE alone, with
+// each path's totals and its --top K (default 20) largest subdirectories.
+// --uring selects the experimental io_uring delete backend, which measured slower than
+// the default thread backend; it is there for comparison, not for speed.
+// Exit status: 0 when every root succeeded, 1 otherwise, 2 on bad usage (including a
+// numeric option that is not a whole number in range).
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <iomanip>
+#include <cstdlib>
+#include <cstdio>
+
+#include "DiskCleanerEngine.h"
+#include "DiskCleanerWalker.h"
+#include "DiskCleanerDevices.h"
+#include "DiskCleanerFilter.h"
+#include "DiskCleanerRetention.h"
+#include "DiskCleanerBudget.h"
+#include "DiskCleanerDuplicates.h"
+#include "DiskCleanerTopK.h"
+#include "DiskCleanerUsageIndex.h"
+
+struct CliOptions {
+    std::string command;
+    std::vector<std::string> roots;
+    bool dryRun = false;
+    bool json = false;
+    bool adaptive = true;
+    size_t threads = 0;
+    unsigned timeoutSeconds = 0;
+    std::string tuningFile;
+    std::string traceFile;
+    PathFilter filter;
+    RetentionPolicy retention;
+    bool freeBudget = false;
+    uint64_t freeBytes = 0;
+    uint64_t minSize = 1;
+    bool applyAction = false;
+    DuplicateAction action = DuplicateAction::Delete;
+    size_t top = 20;
+    std::string indexFile;
+    DeleteBackend backend = DeleteBackend::Threads;
+};
+
+struct PhaseReport {
+    std::string phase;
+    double seconds = 0;
+    uintmax_t bytes = 0;
+    uintmax_t files = 0;
+    uintmax_t directories = 0;
+    uintmax_t skipped = 0;
+    uintmax_t kept = 0;
+};
+
+struct TargetReport {
+    std::string root;
+    std::string device;
+    DeviceKind kind = DeviceKind::Unknown;
+    std::vector<PhaseReport> phases;
+    size_t workers = 0;  // what the adaptive controller settled on, 0 if not measured
+    bool success = true;
+    std::string error;
+};
+
+// Upper bounds for the numeric options; anything above is a typo rather than a setting.
+static constexpr unsigned long long MaxThreads = 1024;
+static constexpr unsigned long long MaxTimeoutSeconds = 7 * 24 * 3600;
+static constexpr unsigned long long MaxTop = 100000;
+
+// A whole decimal number in [min, max], see ParseWholeNumber.
+template <typename T>
+static bool ParseNumber(const std::string& text, unsigned long long min, unsigned long long max, T& out) {
+    unsigned long long value = 0;
+    if (!ParseWholeNumber(text, max, value) || value < min) return false;
+    out = static_cast<T>(value);
+    return true;
+}
+
+static bool ParseOptions(int argc, char** argv, CliOptions& options) {
+    if (argc < 2) return false;
+    options.command = argv[1];
+    if (options.command != "size" && options.command != "clean" && options.command != "dupes" &&
+        options.command != "top" && options.command != "du") return false;
+
+    for (int i = 2; i < argc; ++i) {
+        std::string arg = argv[i];
+        auto next = [&]() -> std::string { return i + 1 < argc ? argv[++i] : ""; };
+
+        if (arg == "--dry-run") options.dryRun = true;
+        else if (arg == "--json") options.json = true;
+        else if (arg == "--fixed") options.adaptive = false;
+        else if (arg == "--uring") options.backend = DeleteBackend::IoUring;
+        else if (arg == "--threads") {
+            if (!ParseNumber(next(), 1, MaxThreads, options.threads)) return false;
+        } else if (arg == "--timeout") {
+            if (!ParseNumber(next(), 1, MaxTimeoutSeconds, options.timeoutSeconds)) return false;
+        }
+        else if (arg == "--tuning") options.tuningFile = next();
+        else if (arg == "--trace") options.traceFile = next();
+        else if (arg == "--index") options.indexFile = next();
+        else if (arg == "--top") {
+            if (!ParseNumber(next(), 1, MaxTop, options.top)) return false;
+        } else if (arg == "--include") {
+            if (!options.filter.Include(next())) return false;
+        } else if (arg == "--exclude") {
+            if (!options.filter.Exclude(next())) return false;
+        } else if (arg == "--filters") {
+            std::string error;
+            if (!options.filter.LoadRules(next(), error)) {
+                std::cerr << error << std::endl;
+                return false;
+            }
+        } else if (arg == "--retain") {
+            if (!RetentionPolicy::Parse(next(), options.retention)) return false;
+        } else if (arg == "--free") {
+            if (!ParseByteCount(next(), options.freeBytes)) return false;
+            options.freeBudget = true;
+        } else if (arg == "--min-size") {
+            if (!ParseByteCount(next(), options.minSize)) return false;
+        } else if (arg == "--action") {
+            std::string action = next();
+            if (action == "delete") options.action = DuplicateAction::Delete;
+            else if (action == "hardlink") options.action = DuplicateAction::HardLink;
+            else if (action == "reflink") options.action = DuplicateAction::Reflink;
+            else return false;
+            options.applyAction = true;
+        }
+        else if (arg.size() > 2 && arg.compare(0, 2, "--") == 0) return false;
+        else options.roots.push_back(arg);
+    }
+    if (options.indexFile.empty() ? options.command == "du" : options.command != "size" && options.command != "du") return false;
+    return !options.roots.empty();
+}
+
+static std::string JsonString(const std::string& text) {
+    std::string out = "\"";
+    for (unsigned char c : text) {
+        switch (c) {
+            case '"': out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\n': out += "\\n"; break;
+            case '\r': out += "\\r"; break;
+            case '\t': out += "\\t"; break;
+            default:
+                if (c < 0x20) {
+                    char escaped[8];
+                    std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+                    out += escaped;
+                } else {
+                    out += static_cast<char>(c);
+                }
+        }
+    }
+    return out + "\"";
+}
+
+static std::string PhaseJson(const PhaseReport& phase) {
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(3);
+    out << "{\"phase\":" << JsonString(phase.phase) << ",\"seconds\":" << phase.seconds << ",\"bytes\":" << phase.bytes
+        << ",\"files\":" << phase.files << ",\"directories\":" << phase.directories << ",\"skipped\":" << phase.skipped
+        << ",\"kept\":" << phase.kept << std::setprecision(0) << ",\"filesPerSecond\":" << (phase.seconds > 0 ? phase.files / phase.seconds : 0)
+        << ",\"bytesPerSecond\":" << (phase.seconds > 0 ? phase.bytes / phase.seconds : 0) << "}";
+    return out.str();
+}
+
+static std::string LatencyJson() {
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(3) << "{";
+    bool first = true;
+    for (size_t i = 0; i < static_cast<size_t>(TracePhase::Count); ++i) {
+        LatencySummary summary = Tracer::Global().Summary(static_cast<TracePhase>(i));
+        if (summary.count == 0) continue;
+        out << (first ? "" : ",") << JsonString(TracePhaseName(static_cast<TracePhase>(i))) << ":{\"count\":"
+            << summary.count << ",\"p50Us\":" << summary.p50Ns / 1000.0 << ",\"p99Us\":" << summary.p99Ns / 1000.0
+            << ",\"totalMs\":" << summary.totalNs / 1e6 << "}";
+        first = false;
+    }
+    out << "}";
+    return out.str();
+}
+
+static std::string TargetJson(const TargetReport& target) {
+    std::ostringstream out;
+    out << "{\"type\":\"target\",\"root\":" << JsonString(target.root) << ",\"device\":" << JsonString(target.device)
+        << ",\"deviceKind\":" << JsonString(DeviceKindText(target.kind)) << ",\"phases\":[";
+    for (size_t i = 0; i < target.phases.size(); ++i) {
+        out << (i ? "," : "") << PhaseJson(target.phases[i]);
+    }
+    out << "]";
+    if (target.workers) out << ",\"workers\":" << target.workers;
+    out << ",\"success\":" << (target.success ? "true" : "false");
+    if (!target.error.empty()) out << ",\"error\":" << JsonString(target.error);
+    out << "}";
+    return out.str();
+}
+
+static PhaseReport ScanPhase(const WalkTotals& totals, std::chrono::steady_clock::time_point start) {
+    PhaseReport scan;
+    scan.phase = "scan";
+    scan.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    scan.bytes = totals.bytes;
+    scan.files = totals.files;
+    scan.directories = totals.directories;
+    scan.skipped = totals.errors;
+    return scan;
+}
+
+// surveyed: the root's scan phase when the budget survey already walked it.
+// sizes: the index to size through for --index.
+static TargetReport RunTarget(const CliOptions& options, const std::string& root, const DeviceGroup& group,
+                              TaskScheduler& scheduler, DeviceTuning& tuning, FreeSpaceBudget* budget,
+                              const PhaseReport* surveyed, SizeIndex* sizes) {
+    TargetReport report;
+    report.root = root;
+    report.device = group.device.name;
+    report.kind = group.device.kind;
+
+    std::error_code ec;
+    if (!fs::is_directory(root, ec)) {
+        report.success = false;
+        report.error = "not a directory";
+        return report;
+    }
+
+    CancellationToken control;
+    if (options.timeoutSeconds) control.SetTimeout(std::chrono::seconds(options.timeoutSeconds));
+
+    if (surveyed) {
+        report.phases.push_back(*surveyed);
+    } else {
+        WalkOptions walkOptions;
+        walkOptions.threads = options.threads;
+        walkOptions.scheduler = &scheduler;
+        walkOptions.cancel = &control;
+        ParallelWalker walker(walkOptions);
+
+        auto start = std::chrono::steady_clock::now();
+        WalkTotals totals = sizes ? sizes->Refresh(root, walkOptions) : walker.Walk(root);
+        report.phases.push_back(ScanPhase(totals, start));
+        if (totals.stopped) {
+            report.success = false;
+            report.error = StopReasonText(control.Reason());
+            return report;
+        }
+    }
+
+    if (options.command != "clean") return report;
+
+    DeleteOptions deleteOptions;
+    deleteOptions.dryRun = options.dryRun;
+    deleteOptions.backend = options.backend;
+    deleteOptions.scheduler = &scheduler;
+    deleteOptions.cancel = &control;
+    deleteOptions.adaptive = options.adaptive;
+    deleteOptions.maxThreads = group.policy.threadsPerItem ? group.policy.threadsPerItem : options.threads;
+    deleteOptions.initialThreads = tuning.Lookup(group.device.key);
+    ProgressCounters counters;
+    deleteOptions.progress = &counters;
+    deleteOptions.filter = &options.filter;
+    deleteOptions.retention = options.retention;
+    deleteOptions.budget = budget;
+    DeleteEngine engine(deleteOptions);
+
+    auto start = std::chrono::steady_clock::now();
+    CleanupResult result = engine.DeleteFolderContents(root, root);
+    ProgressTotals removed = counters.Sum();
+    PhaseReport phase;
+    phase.phase = "delete";
+    phase.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    phase.bytes = result.bytesRemoved;
+    phase.files = removed.files;
+    phase.directories = removed.directories;
+    phase.skipped = static_cast<uintmax_t>(result.filesSkipped);
+    phase.kept = static_cast<uintmax_t>(result.filesKept);
+    report.phases.push_back(phase);
+
+    report.workers = engine.Concurrency();
+    if (!options.dryRun && report.workers) tuning.Remember(group.device.key, report.workers);
+    if (!result.success) {
+        report.success = false;
+        report.error = result.errorMessage;
+    }
+    return report;
+}
+
+// The dupes command: one finder over every root, since copies are usually spread over
+// several of them.
+static int RunDuplicates(const CliOptions& options) {
+    TaskScheduler scheduler(options.threads);
+    CancellationToken control;
+    if (options.timeoutSeconds) control.SetTimeout(std::chrono::seconds(options.timeoutSeconds));
+
+    DuplicateOptions findOptions;
+    findOptions.minSize = options.minSize;
+    findOptions.threads = options.threads;
+    findOptions.scheduler = &scheduler;
+    findOptions.cancel = &control;
+    DuplicateFinder finder(findOptions);
+    std::vector<DuplicateGroup> groups = finder.Find(options.roots);
+    const DuplicateStats& stats = finder.Stats();
+
+    std::vector<std::string> lines;
+    uintmax_t freed = 0;
+    size_t replaced = 0, failed = 0;
+    for (const auto& group : groups) {
+        std::ostringstream line;
+        line << "{\"type\":\"group\",\"size\":" << group.size << ",\"reclaimable\":" << group.Reclaimable() << ",\"paths\":[";
+        for (size_t i = 0; i < group.paths.size(); ++i) {
+            line << (i ? "," : "") << JsonString(group.paths[i]);
+        }
+        line << "]";
+        if (options.applyAction) {
+            DuplicateActionResult result = ApplyDuplicateAction(group, options.action, options.dryRun);
+            freed += result.bytesFreed;
+            replaced += result.replaced;
+            failed += result.failed;
+            line << ",\"action\":" << JsonString(DuplicateActionText(options.action)) << ",\"freed\":" << result.bytesFreed
+                 << ",\"replaced\":" << result.replaced << ",\"failed\":" << result.failed;
+            if (!result.errors.empty()) {
+                line << ",\"errors\":[";
+                for (size_t i = 0; i < result.errors.size(); ++i) {
+                    line << (i ? "," : "") << JsonString(result.errors[i]);
+                }
+                line << "]";
+            }
+        }
+        line << "}";
+        if (options.json) {
+            lines.push_back(line.str());
+        } else {
+            std::cout << line.str() << std::endl;
+        }
+    }
+
+    std::ostringstream summary;
+    summary << std::fixed << std::setprecision(3);
+    summary << "{\"type\":\"summary\",\"command\":\"dupes\",\"targets\":" << options.roots.size()
+            << ",\"files\":" << stats.files << ",\"sameSize\":" << stats.sizeCandidates
+            << ",\"sameEdges\":" << stats.edgeCandidates << ",\"edgeBytesRead\":" << stats.edgeBytesRead
+            << ",\"fullBytesRead\":" << stats.fullBytesRead << ",\"unreadable\":" << stats.unreadable
+            << ",\"groups\":" << stats.groups << ",\"duplicateFiles\":" << stats.duplicateFiles
+            << ",\"reclaimable\":" << stats.reclaimableBytes << ",\"seconds\":{\"walk\":" << stats.walkSeconds
+            << ",\"edges\":" << stats.edgeSeconds << ",\"full\":" << stats.fullSeconds << "}";
+    if (options.applyAction) {
+        summary << ",\"action\":" << JsonString(DuplicateActionText(options.action)) << ",\"dryRun\":"
+                << (options.dryRun ? "true" : "false") << ",\"freed\":" << freed << ",\"replaced\":" << replaced
+                << ",\"failed\":" << failed;
+    }
+    if (stats.stopped) summary << ",\"error\":" << JsonString(StopReasonText(control.Reason()));
+    summary << "}";
+
+    if (options.json) {
+        std::cout << "{\"groups\":[";
+        for (size_t i = 0; i < lines.size(); ++i) {
+            std::cout << (i ? "," : "") << lines[i];
+        }
+        std::cout << "],\"summary\":" << summary.str() << "}" << std::endl;
+    } else {
+        std::cout << summary.str() << std::endl;
+    }
+    return stats.stopped || failed ? 1 : 0;
+}
+
+static std::string SizedPathsJson(const std::vector<SizedPath>& entries) {
+    std::ostringstream out;
+    out << "[";
+    for (size_t i = 0; i < entries.size(); ++i) {
+        out << (i ? "," : "") << "{\"path\":" << JsonString(entries[i].path) << ",\"bytes\":" << entries[i].bytes << "}";
+    }
+    out << "]";
+    return out.str();
+}
+
+// The top command: every root's own lists as it finishes, the merged ones at the end.
+static int RunLargest(const CliOptions& options) {
+    TaskScheduler scheduler(options.threads);
+    std::vector<LargestEntries> results;
+    std::vector<std::string> lines;
+    PhaseReport total;
+    total.phase = "scan";
+    size_t failed = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (const auto& root : options.roots) {
+        CancellationToken control;
+        if (options.timeoutSeconds) control.SetTimeout(std::chrono::seconds(options.timeoutSeconds));
+        WalkOptions walkOptions;
+        walkOptions.threads = options.threads;
+        walkOptions.scheduler = &scheduler;
+        walkOptions.cancel = &control;
+
+        std::ostringstream line;
+        line << "{\"type\":\"target\",\"root\":" << JsonString(root);
+        std::error_code ec;
+        if (!fs::is_directory(root, ec)) {
+            failed++;
+            line << ",\"success\":false,\"error\":\"not a directory\"}";
+        } else {
+            auto rootStart = std::chrono::steady_clock::now();
+            results.push_back(FindLargest(root, options.top, walkOptions));
+            const LargestEntries& largest = results.back();
+            PhaseReport scan = ScanPhase(largest.totals, rootStart);
+            total.bytes += scan.bytes;
+            total.files += scan.files;
+            total.directories += scan.directories;
+            total.skipped += scan.skipped;
+            line << ",\"phases\":[" << PhaseJson(scan) << "],\"files\":" << SizedPathsJson(largest.files)
+                 << ",\"directories\":" << SizedPathsJson(largest.directories);
+            if (largest.totals.stopped) {
+                failed++;
+                line << ",\"success\":false,\"error\":" << JsonString(StopReasonText(control.Reason())) << "}";
+            } else {
+                line << ",\"success\":true}";
+            }
+        }
+        if (options.json) {
+            lines.push_back(line.str());
+        } else {
+            std::cout << line.str() << std::endl;
+        }
+    }
+    total.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::vector<const std::vector<SizedPath>*> files, directories;
+    for (const auto& largest : results) {
+        files.push_back(&largest.files);
+        directories.push_back(&largest.directories);
+    }
+    std::ostringstream summary;
+    summary << "{\"type\":\"summary\",\"command\":\"top\",\"targets\":" << options.roots.size() << ",\"failed\":" << failed
+            << ",\"total\":" << PhaseJson(total) << ",\"files\":" << SizedPathsJson(MergeLargest(files, options.top))
+            << ",\"directories\":" << SizedPathsJson(MergeLargest(directories, options.top)) << "}";
+
+    if (options.json) {
+        std::cout << "{\"targets\":[";
+        for (size_t i = 0; i < lines.size(); ++i) {
+            std::cout << (i ? "," : "") << lines[i];
+        }
+        std::cout << "],\"summary\":" << summary.str() << "}" << std::endl;
+    } else {
+        std::cout << summary.str() << std::endl;
+    }
+    return failed ? 1 : 0;
+}
+
+// The du command: answered from the usage index only, the paths are never touched.
+static int RunUsage(const CliOptions& options) {
+    UsageIndex index;
+    auto start = std::chrono::steady_clock::now();
+    if (!index.Open(options.indexFile)) {
+        std::cerr << "Could not open index " << options.indexFile << std::endl;
+        return 1;
+    }
+    size_t missing = 0;
+    std::vector<std::string> lines;
+    for (const auto& path : options.roots) {
+        std::ostringstream line;
+        line << "{\"type\":\"directory\",\"path\":" << JsonString(path);
+        uint32_t node = index.Find(path);
+        if (node == UsageIndex::None) {
+            missing++;
+            line << ",\"error\":\"not in index\"}";
+        } else {
+            line << ",\"bytes\":" << index.SubtreeBytes(node) << ",\"files\":" << index.SubtreeFiles(node)
+                 << ",\"ownBytes\":" << index.OwnBytes(node) << ",\"ownFiles\":" << index.OwnFiles(node)
+                 << ",\"subdirectories\":" << index.ChildCount(node) << ",\"children\":[";
+            uint32_t first = index.FirstChild(node);
+            uint32_t shown = static_cast<uint32_t>((std::min<size_t>)(index.ChildCount(node), options.top));
+            for (uint32_t child = first; child < first + shown; ++child) {
+                line << (child > first ? "," : "") << "{\"name\":" << JsonString(std::string(index.Name(child)))
+                     << ",\"bytes\":" << index.SubtreeBytes(child) << ",\"files\":" << index.SubtreeFiles(child) << "}";
+            }
+            line << "]}";
+        }
+        if (options.json) {
+            lines.push_back(line.str());
+        } else {
+            std::cout << line.str() << std::endl;
+        }
+    }
+
+    std::ostringstream summary;
+    summary << std::fixed << std::setprecision(6) << "{\"type\":\"summary\",\"command\":\"du\",\"index\":"
+            << JsonString(options.indexFile) << ",\"directories\":" << index.Nodes() << ",\"roots\":" << index.Roots()
+            << ",\"missing\":" << missing << ",\"seconds\":"
+            << std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() << "}";
+    if (options.json) {
+        std::cout << "{\"directories\":[";
+        for (size_t i = 0; i < lines.size(); ++i) {
+            std::cout << (i ? "," : "") << lines[i];
+        }
+        std::cout << "],\"summary\":" << summary.str() << "}" << std::endl;
+    } else {
+        std::cout << summary.str() << std::endl;
+    }
+    return missing ? 1 : 0;
+}
+
+int main(int argc, char** argv) {
+    CliOptions options;
+    if (!ParseOptions(argc, argv, options)) {
+        std::cerr << "Usage: DiskCleanerCli <size|clean> [--dry-run] [--threads N] [--timeout SEC] [--fixed] [--uring] "
+                     "[--tuning FILE] [--trace FILE] [--include PATTERN] [--exclude PATTERN] [--filters FILE] [--retain SPEC] [--free SIZE] "
+                     "[--index FILE] [--json] ROOT...\n"
+                     "       DiskCleanerCli dupes [--min-size SIZE] [--action delete|hardlink|reflink] [--dry-run] [--threads N] "
+                     "[--timeout SEC] [--json] ROOT...\n"
+                     "       DiskCleanerCli top [--top K] [--threads N] [--timeout SEC] [--json] ROOT...\n"
+                     "       DiskCleanerCli du --index FILE [--top K] [--json] PATH...\n"
+                     "--uring selects the experimental io_uring delete backend; it is slower than the default." << std::endl;
+        return 2;
+    }
+    if (options.command == "dupes") return RunDuplicates(options);
+    if (options.command == "top") return RunLargest(options);
+    if (options.command == "du") return RunUsage(options);
+
+    DeviceTuning tuning;
+    if (!options.tuningFile.empty()) tuning.Load(options.tuningFile);
+
+    // One pool for every root, like the GUI's shared scheduler; roots on one spinning
+    // disk still run one after another.
+    TaskScheduler scheduler(options.threads);
+    std::vector<DeviceGroup> groups = GroupByDevice(options.roots);
+    CompletionQueue<TargetReport> completions;
+    if (!options.traceFile.empty()) Tracer::Global().Start();
+
+    auto start = std::chrono::steady_clock::now();
+
+    SizeIndex sizes;
+
+    // The budget needs every root's histogram before the first file goes. --timeout bounds
+    // each root's survey like a scan; a root whose survey stopped adds nothing to the plan
+    // and fails without being cleaned.
+    std::unique_ptr<FreeSpaceBudget> budget;
+    std::vector<PhaseReport> surveys;
+    std::vector<std::string> surveyErrors(options.roots.size());
+    if (options.freeBudget && options.command == "clean") {
+        budget = std::make_unique<FreeSpaceBudget>(options.freeBytes);
+        for (size_t i = 0; i < options.roots.size(); ++i) {
+            CancellationToken control;
+            if (options.timeoutSeconds) control.SetTimeout(std::chrono::seconds(options.timeoutSeconds));
+            WalkOptions walkOptions;
+            walkOptions.threads = options.threads;
+            walkOptions.scheduler = &scheduler;
+            walkOptions.cancel = &control;
+            auto surveyStart = std::chrono::steady_clock::now();
+            WalkTotals totals = SurveyFreeSpace(*budget, options.roots[i], walkOptions, &options.filter, options.retention);
+            surveys.push_back(ScanPhase(totals, surveyStart));
+            if (totals.stopped) surveyErrors[i] = StopReasonText(control.Reason());
+        }
+        budget->Plan();
+    }
+
+    TaskGroup targets(scheduler);
+    RunPerDevice(targets, groups, [&](size_t i, const DeviceGroup& group) {
+        TargetReport report;
+        if (!surveyErrors[i].empty()) {
+            report.root = options.roots[i];
+            report.device = group.device.name;
+            report.kind = group.device.kind;
+            report.phases.push_back(surveys[i]);
+            report.success = false;
+            report.error = surveyErrors[i];
+            completions.Push(std::move(report));
+            return;
+        }
+        try {
+            report = RunTarget(options, options.roots[i], group, scheduler, tuning, budget.get(),
+                               budget ? &surveys[i] : nullptr, options.indexFile.empty() ? nullptr : &sizes);
+        } catch (const std::exception& e) {
+            report.root = options.roots[i];
+            report.success = false;
+            report.error = e.what();
+        }
+        completions.Push(std::move(report));
+    });
+
+    std::vector<std::string> lines;
+    PhaseReport total;
+    size_t failed = 0;
+    for (size_t received = 0; received < options.roots.size(); ++received) {
+        TargetReport report;
+        completions.Pop(report);
+        if (!report.success) failed++;
+        if (!report.phases.empty()) {
+            const PhaseReport& last = report.phases.back();
+            total.bytes += last.bytes;
+            total.files += last.files;
+            total.directories += last.directories;
+            total.skipped += last.skipped;
+            total.kept += last.kept;
+        }
+
+        std::string line = TargetJson(report);
+        if (options.json) {
+            lines.push_back(line);
+        } else {
+            std::cout << line << std::endl;
+        }
+    }
+    targets.Wait();
+    total.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (!options.traceFile.empty()) {
+        Tracer::Global().Stop();
+        if (!Tracer::Global().WriteChromeTrace(options.traceFile)) {
+            std::cerr << "Could not write trace to " << options.traceFile << std::endl;
+        }
+    }
+
+    if (!options.tuningFile.empty() && options.command == "clean" && !options.dryRun) tuning.Save(options.tuningFile);
+    if (!options.indexFile.empty() && !UsageIndex::Write(options.indexFile, sizes, options.roots)) {
+        std::cerr << "Could not write index to " << options.indexFile << std::endl;
+        failed++;
+    }
+
+    total.phase = options.command == "clean" ? (options.dryRun ? "dry-run" : "delete") : "scan";
+    std::ostringstream summary;
+    summary << "{\"type\":\"summary\",\"command\":" << JsonString(options.command) << ",\"targets\":" << options.roots.size()
+            << ",\"failed\":" << failed << ",\"workers\":" << scheduler.Workers() << ",\"total\":" << PhaseJson(total);
+    if (budget) {
+        summary << ",\"budget\":{\"target\":" << budget->Target() << ",\"surveyed\":" << budget->SurveyedBytes()
+                << ",\"admitted\":" << budget->Admitted() << ",\"met\":" << (budget->Met() ? "true" : "false") << "}";
+    }
+    if (!options.traceFile.empty()) {
+        summary << ",\"latency\":" << LatencyJson() << ",\"droppedEvents\":" << Tracer::Global().DroppedEvents();
+    }
+    summary << "}";
+
+    if (options.json) {
+        std::cout << "{\"targets\":[";
+        for (size_t i = 0; i < lines.size(); ++i) {
+            std::cout << (i ? "," : "") << lines[i];
+        }
+        std::cout << "],\"summary\":" << summary.str() << "}" << std::endl;
+    } else {
+        std::cout << summary.str() << std::endl;
+    }
+    return failed ? 1 : 0;
+}
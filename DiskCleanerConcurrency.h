@@ -0,0 +1,108 @@
+#pragma once
+
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+
+// =====================================================================================
+// ADAPTIVE CONCURRENCY
+// =====================================================================================
+// Hill-climbing controller for the number of delete workers. Workers report how many
+// entries each batch removed; every window (100 ms and at least MinSamples entries) the
+// controller compares the rate with the previous window and moves the limit: further in
+// the same direction while throughput improves, back when it drops, and down when it is
+// flat, since the same rate with fewer workers is the knee we are looking for. Steps
+// double while a direction keeps paying off and reset to one on a reversal.
+//
+// Every window's rate is folded into a per-limit moving average; Settled() is the
+// smallest limit within Tolerance of the best average, which is what gets remembered
+// for the device.
+// =====================================================================================
+
+class ConcurrencyController {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    static constexpr double Tolerance = 0.05;
+    static constexpr size_t MinSamples = 32;
+    static constexpr size_t MinWindows = 3;
+
+    ConcurrencyController(size_t initial, size_t maxLimit,
+                          Clock::duration window = std::chrono::milliseconds(100))
+        : maxLimit((std::max)(size_t(1), maxLimit)), window(window), windowStart(Clock::now()) {
+        limit = (std::min)((std::max)(size_t(1), initial), this->maxLimit);
+    }
+
+    size_t Limit() const { return limit.load(std::memory_order_relaxed); }
+
+    void Completed(size_t entries) {
+        std::lock_guard<std::mutex> lock(mutex);
+        completed += entries;
+        auto now = Clock::now();
+        if (now - windowStart < window || completed < MinSamples) return;
+
+        double rate = completed / std::chrono::duration<double>(now - windowStart).count();
+        completed = 0;
+        windowStart = now;
+        Evaluate(rate);
+    }
+
+    // Worker count to start from next time, or 0 if the run was too short to tell.
+    size_t Settled() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (windows < MinWindows) return 0;
+        double best = 0;
+        for (const auto& [count, rate] : rates) best = (std::max)(best, rate);
+        for (const auto& [count, rate] : rates) {
+            if (rate >= best * (1 - Tolerance)) return count;
+        }
+        return Limit();
+    }
+
+    size_t Windows() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return windows;
+    }
+
+private:
+    void Evaluate(double rate) {
+        size_t current = Limit();
+        double& average = rates[current];
+        average = average > 0 ? 0.5 * average + 0.5 * rate : rate;
+        windows++;
+
+        if (lastRate > 0) {
+            if (rate >= lastRate * (1 + Tolerance)) {
+                step = (std::min)(step * 2, maxLimit);
+            } else if (rate <= lastRate * (1 - Tolerance)) {
+                direction = -direction;
+                step = 1;
+            } else {
+                direction = -1;
+                step = 1;
+            }
+        }
+        lastRate = rate;
+
+        if (direction > 0 && current >= maxLimit) direction = -1;
+        if (direction < 0 && current <= 1) direction = 1;
+        size_t next = direction > 0 ? (std::min)(current + step, maxLimit)
+                                    : current - (std::min)(step, current - 1);
+        limit.store(next, std::memory_order_relaxed);
+    }
+
+    const size_t maxLimit;
+    const Clock::duration window;
+    std::atomic<size_t> limit{1};
+
+    mutable std::mutex mutex;
+    Clock::time_point windowStart;
+    size_t completed = 0;
+    size_t windows = 0;
+    double lastRate = 0;
+    int direction = 1;
+    size_t step = 1;
+    std::map<size_t, double> rates;  // limit -> moving average of entries per second
+};
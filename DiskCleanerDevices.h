@@ -0,0 +1,294 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <atomic>
+#include <fstream>
+#include <sstream>
+#include <mutex>
+#include <filesystem>
+#include <system_error>
+#include <cstdlib>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <winioctl.h>
+#else
+#include <sys/types.h>
+#include <sys/stat.h>
+#endif
+#ifdef __linux__
+#include <sys/sysmacros.h>
+#endif
+
+#include "DiskCleanerScheduler.h"
+
+namespace fs = std::filesystem;
+
+// =====================================================================================
+// DEVICES
+// =====================================================================================
+// Cleanup items are grouped by the physical device they live on and each device gets a
+// concurrency limit from its kind. Items on a spinning disk run one at a time with few
+// threads, because parallel unlinks there turn into seeks; items on SSDs and on devices
+// that cannot be classified run fully in parallel as before. Different devices never
+// wait for each other.
+//
+// The key is the whole disk, not the filesystem: two partitions of one HDD share a
+// group. Linux resolves st_dev through /sys/dev/block (falling back to the mount source
+// in /proc/self/mountinfo for btrfs and other anonymous st_dev filesystems) and reads
+// queue/rotational. Windows asks the volume for its disk number and seek penalty.
+// =====================================================================================
+
+enum class DeviceKind {
+    Unknown,
+    SolidState,
+    Rotational
+};
+
+struct DeviceInfo {
+    std::string key;   // groups items; empty when the path could not be resolved
+    std::string name;  // for logging, e.g. "sda" or "PhysicalDrive0"
+    DeviceKind kind = DeviceKind::Unknown;
+};
+
+struct DevicePolicy {
+    size_t itemsAtOnce = 0;     // 0 = no limit
+    size_t threadsPerItem = 0;  // 0 = the engine's default
+};
+
+inline const char* DeviceKindText(DeviceKind kind) {
+    switch (kind) {
+        case DeviceKind::SolidState: return "solid-state";
+        case DeviceKind::Rotational: return "rotational";
+        default: return "unknown";
+    }
+}
+
+inline DevicePolicy PolicyFor(DeviceKind kind) {
+    DevicePolicy policy;
+    if (kind == DeviceKind::Rotational) {
+        // Two batches in flight still let the disk reorder requests without seeking
+        // between two items' directories.
+        policy.itemsAtOnce = 1;
+        policy.threadsPerItem = 2;
+    }
+    return policy;
+}
+
+#ifdef __linux__
+// Whole-disk sysfs directory for a block device number, or empty.
+inline fs::path BlockDeviceDir(dev_t device) {
+    std::error_code ec;
+    fs::path dir = fs::canonical("/sys/dev/block/" + std::to_string(major(device)) + ":" +
+                                 std::to_string(minor(device)), ec);
+    if (ec) return {};
+    if (fs::exists(dir / "partition", ec)) {
+        dir = dir.parent_path();
+    }
+    return dir;
+}
+
+// Block device named as the mount source of the filesystem holding path, for
+// filesystems whose st_dev is not a real device number.
+inline bool MountSourceDevice(const std::string& path, dev_t& device) {
+    std::error_code ec;
+    std::string target = fs::canonical(path, ec).string();
+    if (ec) return false;
+
+    std::ifstream mountinfo("/proc/self/mountinfo");
+    std::string line, bestSource;
+    size_t bestLength = 0;
+    while (std::getline(mountinfo, line)) {
+        // id parent major:minor root mountpoint options [optional...] - fstype source superopts
+        std::vector<std::string> fields;
+        size_t start = 0;
+        while (start < line.size()) {
+            size_t end = line.find(' ', start);
+            if (end == std::string::npos) end = line.size();
+            fields.push_back(line.substr(start, end - start));
+            start = end + 1;
+        }
+        if (fields.size() < 5) continue;
+        size_t separator = 0;
+        for (size_t i = 5; i < fields.size(); ++i) {
+            if (fields[i] == "-") {
+                separator = i;
+                break;
+            }
+        }
+        if (separator == 0 || separator + 2 >= fields.size()) continue;
+
+        const std::string& mountPoint = fields[4];
+        bool under = target.compare(0, mountPoint.size(), mountPoint) == 0 &&
+                     (target.size() == mountPoint.size() || mountPoint == "/" || target[mountPoint.size()] == '/');
+        if (under && mountPoint.size() >= bestLength) {
+            bestLength = mountPoint.size();
+            bestSource = fields[separator + 2];
+        }
+    }
+
+    struct stat st;
+    if (bestSource.compare(0, 5, "/dev/") != 0 || ::stat(bestSource.c_str(), &st) != 0 || !S_ISBLK(st.st_mode)) {
+        return false;
+    }
+    device = st.st_rdev;
+    return true;
+}
+#endif
+
+#ifdef _WIN32
+inline HANDLE OpenVolume(const std::string& rootName) {
+    std::wstring volume = L"\\\\.\\" + fs::path(rootName).wstring();
+    return CreateFileW(volume.c_str(), 0, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, 0, NULL);
+}
+#endif
+
+inline DeviceInfo ResolveDevice(const std::string& path) {
+    DeviceInfo info;
+#ifdef _WIN32
+    std::string rootName = fs::path(path).root_name().string();
+    if (rootName.empty()) return info;
+    info.key = info.name = rootName;
+
+    HANDLE volume = OpenVolume(rootName);
+    if (volume == INVALID_HANDLE_VALUE) return info;
+    DWORD returned = 0;
+
+    STORAGE_DEVICE_NUMBER number = {};
+    if (DeviceIoControl(volume, IOCTL_STORAGE_GET_DEVICE_NUMBER, NULL, 0, &number, sizeof(number), &returned, NULL)) {
+        info.key = info.name = "PhysicalDrive" + std::to_string(number.DeviceNumber);
+    }
+
+    STORAGE_PROPERTY_QUERY query = {};
+    query.PropertyId = StorageDeviceSeekPenaltyProperty;
+    query.QueryType = PropertyStandardQuery;
+    DEVICE_SEEK_PENALTY_DESCRIPTOR penalty = {};
+    if (DeviceIoControl(volume, IOCTL_STORAGE_QUERY_PROPERTY, &query, sizeof(query), &penalty, sizeof(penalty),
+                        &returned, NULL) && returned >= sizeof(penalty)) {
+        info.kind = penalty.IncursSeekPenalty ? DeviceKind::Rotational : DeviceKind::SolidState;
+    }
+    CloseHandle(volume);
+#else
+    struct stat st;
+    if (::stat(path.c_str(), &st) != 0) return info;
+    info.key = info.name = "dev " + std::to_string(static_cast<unsigned long long>(st.st_dev));
+#ifdef __linux__
+    dev_t device = st.st_dev;
+    fs::path dir = BlockDeviceDir(device);
+    if (dir.empty() && MountSourceDevice(path, device)) {
+        dir = BlockDeviceDir(device);
+    }
+    if (dir.empty()) return info;
+
+    info.key = info.name = dir.filename().string();
+    std::ifstream rotational(dir / "queue" / "rotational");
+    int flag = -1;
+    if (rotational >> flag) {
+        info.kind = flag ? DeviceKind::Rotational : DeviceKind::SolidState;
+    }
+#endif
+#endif
+    return info;
+}
+
+struct DeviceGroup {
+    DeviceInfo device;
+    DevicePolicy policy;
+    std::vector<size_t> items;  // indices into the paths passed to GroupByDevice
+};
+
+// Groups paths by device, in order of first appearance.
+inline std::vector<DeviceGroup> GroupByDevice(const std::vector<std::string>& paths) {
+    std::vector<DeviceGroup> groups;
+    std::map<std::string, size_t> groupByKey;
+    for (size_t i = 0; i < paths.size(); ++i) {
+        DeviceInfo device = ResolveDevice(paths[i]);
+        auto it = groupByKey.find(device.key);
+        if (it == groupByKey.end()) {
+            it = groupByKey.emplace(device.key, groups.size()).first;
+            DevicePolicy policy = PolicyFor(device.kind);
+            groups.push_back({std::move(device), policy, {}});
+        }
+        groups[it->second].items.push_back(i);
+    }
+    return groups;
+}
+
+// Queues run(item, group) on tasks for every item, never running more items of one
+// group at a time than its policy allows. Unlimited groups get one task per item so the
+// scheduler can interleave them; limited ones get that many tasks taking items in turn.
+template <typename Run>
+void RunPerDevice(TaskGroup& tasks, const std::vector<DeviceGroup>& groups, Run run) {
+    for (const auto& group : groups) {
+        auto shared = std::make_shared<DeviceGroup>(group);
+        if (group.policy.itemsAtOnce == 0) {
+            for (size_t item : group.items) {
+                tasks.Run([run, shared, item]() { run(item, *shared); });
+            }
+            continue;
+        }
+
+        auto next = std::make_shared<std::atomic<size_t>>(0);
+        size_t lanes = (std::min)(group.policy.itemsAtOnce, group.items.size());
+        for (size_t lane = 0; lane < lanes; ++lane) {
+            tasks.Run([run, shared, next]() {
+                for (size_t i; (i = next->fetch_add(1)) < shared->items.size();) {
+                    run(shared->items[i], *shared);
+                }
+            });
+        }
+    }
+}
+
+// Worker counts the adaptive delete controller settled on, per device key, so the next
+// run starts near the knee instead of climbing to it again. Stored as key|threads lines.
+class DeviceTuning {
+public:
+    size_t Lookup(const std::string& key) const {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = threads.find(key);
+        return it == threads.end() ? 0 : it->second;
+    }
+
+    void Remember(const std::string& key, size_t count) {
+        if (key.empty() || count == 0) return;
+        std::lock_guard<std::mutex> lock(mutex);
+        threads[key] = count;
+    }
+
+    bool Load(const std::string& filePath) {
+        std::ifstream file(filePath);
+        if (!file.is_open()) return false;
+        std::map<std::string, size_t> loaded;
+        std::string line;
+        while (std::getline(file, line)) {
+            size_t separator = line.rfind('|');
+            if (separator == std::string::npos) continue;
+            size_t count = std::strtoull(line.c_str() + separator + 1, nullptr, 10);
+            if (count > 0) loaded[line.substr(0, separator)] = count;
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        threads = std::move(loaded);
+        return true;
+    }
+
+    bool Save(const std::string& filePath) const {
+        std::ostringstream data;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            for (const auto& [key, count] : threads) {
+                data << key << "|" << count << "\n";
+            }
+        }
+        std::ofstream file(filePath, std::ios::trunc);
+        file << data.str();
+        return static_cast<bool>(file);
+    }
+
+private:
+    mutable std::mutex mutex;
+    std::map<std::string, size_t> threads;
+};
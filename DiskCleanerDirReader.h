@@ -0,0 +1,176 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <memory>
+#include <filesystem>
+#include <system_error>
+#include <cstdint>
+
+#include "DiskCleanerTrace.h"
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/syscall.h>
+#endif
+
+namespace fs = std::filesystem;
+
+// =====================================================================================
+// DIRECTORY READER
+// =====================================================================================
+// Bulk enumeration without fs::directory_entry. On Linux entries come straight out of
+// a 64 KB getdents64 buffer: the name is a view into that buffer and d_type tells
+// directories, symlinks and files apart, so only regular files still need a stat (and
+// that one is done relative to the directory fd). Other platforms fall back to
+// fs::directory_iterator behind the same interface.
+//
+// A DirEntryView is only valid until the next call to Next(). name.data() is always
+// NUL-terminated.
+// =====================================================================================
+
+enum class EntryKind : uint8_t {
+    Unknown,
+    Regular,
+    Directory,
+    Symlink,
+    Other
+};
+
+struct DirEntryView {
+    std::string_view name;
+    EntryKind kind = EntryKind::Unknown;
+    uint64_t inode = 0;
+};
+
+class DirectoryReader {
+public:
+    static constexpr size_t BufferSize = 64 * 1024;
+
+    explicit DirectoryReader(const std::string& path) {
+#ifdef __linux__
+        fd = ::open(path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        syscalls++;
+        if (fd < 0) error = errno;
+#else
+        iterator = fs::directory_iterator(path, fs::directory_options::skip_permission_denied, ec);
+        if (ec) error = ec.value();
+#endif
+        opened = (error == 0);
+    }
+
+#ifdef __linux__
+    // Opens name relative to an already open directory, nothing is resolved twice.
+    DirectoryReader(int parentFd, const char* name) {
+        fd = ::openat(parentFd, name, O_RDONLY | O_DIRECTORY | O_CLOEXEC | O_NOFOLLOW);
+        syscalls++;
+        if (fd < 0) error = errno;
+        opened = (error == 0);
+    }
+#endif
+
+    ~DirectoryReader() {
+#ifdef __linux__
+        if (fd >= 0) ::close(fd);
+#endif
+    }
+
+    DirectoryReader(const DirectoryReader&) = delete;
+    DirectoryReader& operator=(const DirectoryReader&) = delete;
+
+    bool IsOpen() const { return opened; }
+
+    // First errno seen while opening or reading; 0 if the listing was complete.
+    int Error() const { return error; }
+
+    // getdents64/open calls made so far; the fallback reports 0.
+    uint64_t Syscalls() const { return syscalls; }
+
+#ifdef __linux__
+    int Fd() const { return fd; }
+#endif
+
+    bool Next(DirEntryView& out) {
+#ifdef __linux__
+        while (true) {
+            if (offset >= filled) {
+                if (fd < 0 || !Fill()) return false;
+            }
+
+            const auto* record = reinterpret_cast<const LinuxDirent64*>(buffer.get() + offset);
+            offset += record->d_reclen;
+
+            const char* name = record->d_name;
+            if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) continue;
+
+            out.name = std::string_view(name);
+            out.inode = record->d_ino;
+            switch (record->d_type) {
+                case DT_REG: out.kind = EntryKind::Regular; break;
+                case DT_DIR: out.kind = EntryKind::Directory; break;
+                case DT_LNK: out.kind = EntryKind::Symlink; break;
+                case DT_UNKNOWN: out.kind = EntryKind::Unknown; break;
+                default: out.kind = EntryKind::Other; break;
+            }
+            return true;
+        }
+#else
+        if (error || iterator == fs::directory_iterator{}) return false;
+
+        currentName = iterator->path().filename().string();
+        out.name = currentName;
+        out.inode = 0;
+
+        std::error_code statusEc;
+        fs::file_status status = iterator->symlink_status(statusEc);
+        if (statusEc) out.kind = EntryKind::Unknown;
+        else if (fs::is_symlink(status)) out.kind = EntryKind::Symlink;
+        else if (fs::is_directory(status)) out.kind = EntryKind::Directory;
+        else if (fs::is_regular_file(status)) out.kind = EntryKind::Regular;
+        else out.kind = EntryKind::Other;
+
+        Traced(TracePhase::Enumerate, [&]() { iterator.increment(ec); });
+        if (ec) error = ec.value();
+        return true;
+#endif
+    }
+
+private:
+#ifdef __linux__
+    struct LinuxDirent64 {
+        uint64_t d_ino;
+        int64_t d_off;
+        unsigned short d_reclen;
+        unsigned char d_type;
+        char d_name[1];
+    };
+
+    bool Fill() {
+        if (!buffer) buffer.reset(new char[BufferSize]);
+        long n = Traced(TracePhase::Enumerate, [&]() { return ::syscall(SYS_getdents64, fd, buffer.get(), BufferSize); });
+        syscalls++;
+        if (n <= 0) {
+            if (n < 0) error = errno;
+            filled = offset = 0;
+            return false;
+        }
+        filled = static_cast<size_t>(n);
+        offset = 0;
+        return true;
+    }
+
+    int fd = -1;
+    std::unique_ptr<char[]> buffer;
+    size_t filled = 0;
+    size_t offset = 0;
+#else
+    fs::directory_iterator iterator;
+    std::error_code ec;
+    std::string currentName;
+#endif
+    bool opened = false;
+    int error = 0;
+    uint64_t syscalls = 0;
+};
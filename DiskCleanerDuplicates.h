@@ -0,0 +1,547 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <map>
+#include <memory>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <cstring>
+#include <cstdint>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <linux/fs.h>
+#endif
+
+#include "DiskCleanerWalker.h"
+
+// =====================================================================================
+// DUPLICATE FINDER
+// =====================================================================================
+// Finds files with identical contents below a set of roots in stages, each reading only
+// what the one before could not rule out:
+//   1. size: one parallel walk (hard links to one file count once); a size seen only
+//      once rules the file out without reading a byte
+//   2. edges: the first and last 4 KB of every same-size file are hashed in parallel
+//   3. full: only files whose edges still match are hashed completely, with large
+//      sequential reads that tell the kernel to drop the pages afterwards, so a scan
+//      over gigabytes of installers does not push everything else out of the page cache
+// Groups come back with the bytes that keeping one copy would free. ApplyDuplicateAction
+// then deletes the other copies or turns them into hard links or reflinks of the kept
+// one, comparing contents byte for byte first so a hash collision can never cost data.
+// =====================================================================================
+
+// 64-bit XXH64 over a stream of Update() calls.
+class ContentHash {
+public:
+    explicit ContentHash(uint64_t seed = 0)
+        : lanes{seed + P1 + P2, seed + P2, seed, seed - P1}, seed(seed) {}
+
+    void Update(const void* data, size_t length) {
+        const unsigned char* p = static_cast<const unsigned char*>(data);
+        const unsigned char* end = p + length;
+        total += length;
+        if (buffered + length < 32) {
+            std::memcpy(buffer + buffered, p, length);
+            buffered += length;
+            return;
+        }
+        if (buffered) {
+            size_t fill = 32 - buffered;
+            std::memcpy(buffer + buffered, p, fill);
+            Stripe(buffer);
+            p += fill;
+            buffered = 0;
+        }
+        for (; p + 32 <= end; p += 32) Stripe(p);
+        buffered = static_cast<size_t>(end - p);
+        std::memcpy(buffer, p, buffered);
+    }
+
+    uint64_t Final() const {
+        uint64_t h = total >= 32
+            ? Merge(Merge(Merge(Merge(Rotl(lanes[0], 1) + Rotl(lanes[1], 7) + Rotl(lanes[2], 12) + Rotl(lanes[3], 18),
+                                      lanes[0]), lanes[1]), lanes[2]), lanes[3])
+            : seed + P5;
+        h += total;
+        const unsigned char* p = buffer;
+        const unsigned char* end = buffer + buffered;
+        for (; p + 8 <= end; p += 8) h = Rotl(h ^ Round(0, Read64(p)), 27) * P1 + P4;
+        if (p + 4 <= end) {
+            h = Rotl(h ^ (static_cast<uint64_t>(Read32(p)) * P1), 23) * P2 + P3;
+            p += 4;
+        }
+        for (; p < end; ++p) h = Rotl(h ^ (*p * P5), 11) * P1;
+        h ^= h >> 33;
+        h *= P2;
+        h ^= h >> 29;
+        h *= P3;
+        return h ^ (h >> 32);
+    }
+
+private:
+    static constexpr uint64_t P1 = 11400714785074694791ULL;
+    static constexpr uint64_t P2 = 14029467366897019727ULL;
+    static constexpr uint64_t P3 = 1609587929392839161ULL;
+    static constexpr uint64_t P4 = 9650029242287828579ULL;
+    static constexpr uint64_t P5 = 2870177450012600261ULL;
+
+    static uint64_t Rotl(uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+    static uint64_t Round(uint64_t acc, uint64_t input) { return Rotl(acc + input * P2, 31) * P1; }
+    static uint64_t Merge(uint64_t acc, uint64_t lane) { return (acc ^ Round(0, lane)) * P1 + P4; }
+    static uint64_t Read64(const unsigned char* p) {
+        uint64_t v;
+        std::memcpy(&v, p, 8);
+        return v;
+    }
+    static uint32_t Read32(const unsigned char* p) {
+        uint32_t v;
+        std::memcpy(&v, p, 4);
+        return v;
+    }
+
+    void Stripe(const unsigned char* p) {
+        for (int i = 0; i < 4; ++i) lanes[i] = Round(lanes[i], Read64(p + 8 * i));
+    }
+
+    uint64_t lanes[4];
+    uint64_t seed;
+    uint64_t total = 0;
+    unsigned char buffer[32];
+    size_t buffered = 0;
+};
+
+// Read-only access to one file's contents. With sequential, the kernel is told to read
+// ahead aggressively and, on close, to drop the pages this reader brought in.
+class FileContents {
+public:
+    FileContents(const std::string& path, bool sequential) : sequential(sequential) {
+#ifdef __linux__
+        fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC | O_NOFOLLOW);
+        if (fd >= 0 && sequential) ::posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#else
+        file.open(fs::u8path(path), std::ios::binary);
+#endif
+    }
+
+    ~FileContents() {
+#ifdef __linux__
+        if (fd >= 0) {
+            if (sequential) ::posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+            ::close(fd);
+        }
+#endif
+    }
+
+    FileContents(const FileContents&) = delete;
+    FileContents& operator=(const FileContents&) = delete;
+
+    bool IsOpen() const {
+#ifdef __linux__
+        return fd >= 0;
+#else
+        return file.is_open();
+#endif
+    }
+
+    // Exactly length bytes at offset; false on an error or a file that got shorter.
+    bool ReadAt(uint64_t offset, char* out, size_t length) {
+#ifdef __linux__
+        while (length) {
+            ssize_t got = ::pread(fd, out, length, static_cast<off_t>(offset));
+            if (got <= 0) {
+                if (got < 0 && errno == EINTR) continue;
+                return false;
+            }
+            out += got;
+            offset += static_cast<uint64_t>(got);
+            length -= static_cast<size_t>(got);
+        }
+        return true;
+#else
+        file.seekg(static_cast<std::streamoff>(offset));
+        file.read(out, static_cast<std::streamsize>(length));
+        return static_cast<size_t>(file.gcount()) == length;
+#endif
+    }
+
+private:
+    bool sequential;
+#ifdef __linux__
+    int fd = -1;
+#else
+    std::ifstream file;
+#endif
+};
+
+struct DuplicateOptions {
+    uintmax_t minSize = 1;  // smaller files are ignored; empty files are all "equal"
+    size_t threads = 0;     // readers at once, default: the scheduler's workers
+    TaskScheduler* scheduler = nullptr;
+    const CancellationToken* cancel = nullptr;
+};
+
+struct DuplicateGroup {
+    uintmax_t size = 0;
+    std::vector<std::string> paths;  // sorted; the first is the copy that is kept
+
+    uintmax_t Reclaimable() const { return paths.size() > 1 ? size * (paths.size() - 1) : 0; }
+};
+
+struct DuplicateStats {
+    uintmax_t files = 0;              // regular files walked, at least minSize
+    uintmax_t sizeCandidates = 0;     // sharing their size with another file
+    uintmax_t edgeCandidates = 0;     // also sharing the hash of their first and last 4 KB
+    uintmax_t edgeBytesRead = 0;
+    uintmax_t fullBytesRead = 0;
+    uintmax_t unreadable = 0;
+    size_t groups = 0;
+    uintmax_t duplicateFiles = 0;     // copies beyond the first of every group
+    uintmax_t reclaimableBytes = 0;
+    double walkSeconds = 0;
+    double edgeSeconds = 0;
+    double fullSeconds = 0;
+    bool stopped = false;             // cancelled: no groups are returned
+};
+
+class DuplicateFinder {
+public:
+    static constexpr size_t EdgeBytes = 4096;
+    static constexpr size_t ReadChunk = 1 << 20;
+
+    explicit DuplicateFinder(DuplicateOptions options = {}) : options(options) {}
+
+    // Groups of two or more files with equal contents, most reclaimable first.
+    std::vector<DuplicateGroup> Find(const std::vector<std::string>& roots) {
+        stats = {};
+        candidates.clear();
+        auto stageStart = std::chrono::steady_clock::now();
+        Collect(roots);
+        stats.walkSeconds = SecondsSince(stageStart);
+        if (stats.stopped) return {};
+
+        // Stage 1: sizes seen more than once. Hard links reached through two roots are
+        // one file.
+        std::vector<std::vector<uint32_t>> sets = SameSizeSets();
+        for (const auto& set : sets) stats.sizeCandidates += set.size();
+
+        // Stage 2: first and last EdgeBytes.
+        stageStart = std::chrono::steady_clock::now();
+        std::vector<uint32_t> work;
+        for (const auto& set : sets) work.insert(work.end(), set.begin(), set.end());
+        HashAll(work, false);
+        stats.edgeSeconds = SecondsSince(stageStart);
+        if (stats.stopped) return {};
+        sets = Regroup(sets);
+        for (const auto& set : sets) stats.edgeCandidates += set.size();
+
+        // Stage 3: whole contents, unless the edges already covered the file. Biggest
+        // first, so one large file does not start last and run alone.
+        stageStart = std::chrono::steady_clock::now();
+        work.clear();
+        for (const auto& set : sets) {
+            if (candidates[set.front()].size > 2 * EdgeBytes) work.insert(work.end(), set.begin(), set.end());
+        }
+        std::sort(work.begin(), work.end(), [this](uint32_t a, uint32_t b) { return candidates[a].size > candidates[b].size; });
+        HashAll(work, true);
+        stats.fullSeconds = SecondsSince(stageStart);
+        if (stats.stopped) return {};
+        sets = Regroup(sets);
+
+        std::vector<DuplicateGroup> groups;
+        for (const auto& set : sets) {
+            DuplicateGroup group;
+            group.size = candidates[set.front()].size;
+            for (uint32_t index : set) group.paths.push_back(std::move(candidates[index].path));
+            std::sort(group.paths.begin(), group.paths.end());
+            stats.duplicateFiles += group.paths.size() - 1;
+            stats.reclaimableBytes += group.Reclaimable();
+            groups.push_back(std::move(group));
+        }
+        std::sort(groups.begin(), groups.end(), [](const DuplicateGroup& a, const DuplicateGroup& b) {
+            return a.Reclaimable() != b.Reclaimable() ? a.Reclaimable() > b.Reclaimable() : a.paths < b.paths;
+        });
+        stats.groups = groups.size();
+        candidates.clear();
+        return groups;
+    }
+
+    const DuplicateStats& Stats() const { return stats; }
+
+private:
+    struct Candidate {
+        std::string path;
+        uintmax_t size = 0;
+        uint64_t device = 0;
+        uint64_t inode = 0;
+        uint64_t hash = 0;  // of the last stage that read it
+        bool readable = true;
+    };
+
+    static double SecondsSince(std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    bool Stopped() const { return options.cancel && !options.cancel->Checkpoint(); }
+
+    TaskScheduler& Scheduler() const { return options.scheduler ? *options.scheduler : TaskScheduler::Shared(); }
+
+    void Collect(const std::vector<std::string>& roots) {
+        WalkOptions walkOptions;
+        walkOptions.threads = options.threads;
+        walkOptions.scheduler = &Scheduler();
+        walkOptions.cancel = options.cancel;
+        for (const auto& root : roots) {
+            ParallelWalker walker(walkOptions);
+            std::vector<std::vector<Candidate>> found(walker.Threads());
+            WalkTotals totals = walker.Walk(root, [&](size_t worker, const fs::path& dir, std::string_view name, const EntryStat& st) {
+                if (st.type != fs::file_type::regular || st.size < options.minSize) return;
+                found[worker].push_back({(dir / fs::path(name)).string(), st.size, st.device, st.inode});
+            });
+            for (auto& part : found) {
+                std::move(part.begin(), part.end(), std::back_inserter(candidates));
+            }
+            if (totals.stopped) {
+                stats.stopped = true;
+                return;
+            }
+        }
+        stats.files = candidates.size();
+    }
+
+    std::vector<std::vector<uint32_t>> SameSizeSets() {
+        std::unordered_map<uintmax_t, std::vector<uint32_t>> bySize;
+        for (uint32_t i = 0; i < candidates.size(); ++i) bySize[candidates[i].size].push_back(i);
+        std::vector<std::vector<uint32_t>> sets;
+        for (auto& [size, set] : bySize) {
+            if (set.size() < 2) continue;
+            // The same inode twice (overlapping roots, links across roots) is one file.
+            // Windows reports no inodes, there only repeated paths are dropped.
+            std::sort(set.begin(), set.end(), [this](uint32_t a, uint32_t b) {
+                const Candidate& x = candidates[a];
+                const Candidate& y = candidates[b];
+                return x.device != y.device ? x.device < y.device : x.inode != y.inode ? x.inode < y.inode : x.path < y.path;
+            });
+            set.erase(std::unique(set.begin(), set.end(), [this](uint32_t a, uint32_t b) {
+                          const Candidate& x = candidates[a];
+                          const Candidate& y = candidates[b];
+                          return x.path == y.path || (x.inode != 0 && x.device == y.device && x.inode == y.inode);
+                      }), set.end());
+            if (set.size() >= 2) sets.push_back(std::move(set));
+        }
+        return sets;
+    }
+
+    // Splits every set by the hash just computed; files that could not be read drop out.
+    std::vector<std::vector<uint32_t>> Regroup(const std::vector<std::vector<uint32_t>>& sets) {
+        std::vector<std::vector<uint32_t>> result;
+        for (const auto& set : sets) {
+            std::map<uint64_t, std::vector<uint32_t>> byHash;
+            for (uint32_t index : set) {
+                if (candidates[index].readable) byHash[candidates[index].hash].push_back(index);
+            }
+            for (auto& entry : byHash) {
+                if (entry.second.size() >= 2) result.push_back(std::move(entry.second));
+            }
+        }
+        return result;
+    }
+
+    // Hashes every listed candidate with options.threads readers pulling from a shared
+    // index; each writes only its own candidates.
+    void HashAll(const std::vector<uint32_t>& work, bool full) {
+        if (work.empty()) return;
+        TaskGroup group(Scheduler());
+        size_t readers = options.threads ? options.threads : Scheduler().Workers();
+        readers = (std::max<size_t>)(1, (std::min)(readers, work.size()));
+        std::atomic<size_t> next{0};
+        std::atomic<uintmax_t> bytesRead{0}, unreadable{0};
+        std::atomic<bool> stopped{false};
+        for (size_t r = 0; r < readers; ++r) {
+            group.Run([&, full]() {
+                std::vector<char> buffer(full ? ReadChunk : 2 * EdgeBytes);
+                for (size_t i; (i = next.fetch_add(1, std::memory_order_relaxed)) < work.size();) {
+                    if (stopped.load(std::memory_order_relaxed)) return;
+                    if (Stopped()) {
+                        stopped = true;
+                        return;
+                    }
+                    Candidate& candidate = candidates[work[i]];
+                    uintmax_t read = 0;
+                    candidate.readable = full ? HashFull(candidate, buffer, read) : HashEdges(candidate, buffer, read);
+                    bytesRead.fetch_add(read, std::memory_order_relaxed);
+                    if (!candidate.readable) unreadable.fetch_add(1, std::memory_order_relaxed);
+                }
+            });
+        }
+        group.Wait();
+        (full ? stats.fullBytesRead : stats.edgeBytesRead) += bytesRead.load();
+        stats.unreadable += unreadable.load();
+        if (stopped) stats.stopped = true;
+    }
+
+    static bool HashEdges(Candidate& candidate, std::vector<char>& buffer, uintmax_t& read) {
+        FileContents file(candidate.path, false);
+        if (!file.IsOpen()) return false;
+        size_t head = static_cast<size_t>((std::min<uintmax_t>)(candidate.size, EdgeBytes));
+        uintmax_t tailStart = (std::max<uintmax_t>)(head, candidate.size > EdgeBytes ? candidate.size - EdgeBytes : 0);
+        size_t tail = static_cast<size_t>(candidate.size - tailStart);
+        if (!file.ReadAt(0, buffer.data(), head) || !file.ReadAt(tailStart, buffer.data() + head, tail)) return false;
+        ContentHash hash(candidate.size);
+        hash.Update(buffer.data(), head + tail);
+        candidate.hash = hash.Final();
+        read = head + tail;
+        return true;
+    }
+
+    static bool HashFull(Candidate& candidate, std::vector<char>& buffer, uintmax_t& read) {
+        FileContents file(candidate.path, true);
+        if (!file.IsOpen()) return false;
+        ContentHash hash(candidate.size);
+        for (uintmax_t offset = 0; offset < candidate.size;) {
+            size_t length = static_cast<size_t>((std::min<uintmax_t>)(buffer.size(), candidate.size - offset));
+            if (!file.ReadAt(offset, buffer.data(), length)) return false;
+            hash.Update(buffer.data(), length);
+            offset += length;
+            read += length;
+        }
+        candidate.hash = hash.Final();
+        return true;
+    }
+
+    DuplicateOptions options;
+    DuplicateStats stats;
+    std::vector<Candidate> candidates;
+};
+
+// What to do with the copies of a group beyond the first.
+enum class DuplicateAction {
+    Delete,
+    HardLink,  // the copy's path becomes another name of the kept file (same volume only)
+    Reflink    // the copy shares the kept file's extents (Btrfs, XFS; Linux only)
+};
+
+inline const char* DuplicateActionText(DuplicateAction action) {
+    switch (action) {
+        case DuplicateAction::Delete: return "delete";
+        case DuplicateAction::HardLink: return "hardlink";
+        case DuplicateAction::Reflink: return "reflink";
+        default: return "?";
+    }
+}
+
+struct DuplicateActionResult {
+    uintmax_t bytesFreed = 0;
+    size_t replaced = 0;
+    size_t failed = 0;
+    std::vector<std::string> errors;  // "path: reason"
+};
+
+// Byte-for-byte comparison of two files of the given size.
+inline bool SameContents(const std::string& a, const std::string& b, uintmax_t size) {
+    FileContents first(a, true), second(b, true);
+    if (!first.IsOpen() || !second.IsOpen()) return false;
+    std::vector<char> left(DuplicateFinder::ReadChunk), right(DuplicateFinder::ReadChunk);
+    for (uintmax_t offset = 0; offset < size;) {
+        size_t length = static_cast<size_t>((std::min<uintmax_t>)(left.size(), size - offset));
+        if (!first.ReadAt(offset, left.data(), length) || !second.ReadAt(offset, right.data(), length)) return false;
+        if (std::memcmp(left.data(), right.data(), length) != 0) return false;
+        offset += length;
+    }
+    return true;
+}
+
+// A reflink of source at target, which must not exist yet.
+inline bool CloneFile(const std::string& source, const std::string& target, std::error_code& ec) {
+#if defined(__linux__) && defined(FICLONE)
+    int from = ::open(source.c_str(), O_RDONLY | O_CLOEXEC);
+    if (from < 0) {
+        ec.assign(errno, std::system_category());
+        return false;
+    }
+    int to = ::open(target.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+    if (to < 0) {
+        ec.assign(errno, std::system_category());
+        ::close(from);
+        return false;
+    }
+    bool cloned = ::ioctl(to, FICLONE, from) == 0;
+    if (!cloned) ec.assign(errno, std::system_category());
+    ::close(to);
+    ::close(from);
+    if (!cloned) ::unlink(target.c_str());
+    return cloned;
+#else
+    (void)source;
+    (void)target;
+    ec = std::make_error_code(std::errc::not_supported);
+    return false;
+#endif
+}
+
+// Applies action to every copy after the first. Each copy is compared with the kept file
+// first and left alone if it differs or changed since the scan. Links and reflinks are
+// made under a temporary name and renamed over the copy, so a failure never leaves the
+// path missing. A hard-linked copy takes the kept file's permissions; a reflinked one
+// keeps its own.
+inline DuplicateActionResult ApplyDuplicateAction(const DuplicateGroup& group, DuplicateAction action, bool dryRun = false) {
+    DuplicateActionResult result;
+    if (group.paths.size() < 2) return result;
+    const std::string& keep = group.paths.front();
+    for (size_t i = 1; i < group.paths.size(); ++i) {
+        const std::string& copy = group.paths[i];
+        auto fail = [&](const std::string& reason) {
+            result.failed++;
+            result.errors.push_back(copy + ": " + reason);
+        };
+
+        std::error_code ec;
+        if (fs::equivalent(keep, copy, ec)) {
+            fail("already the same file as " + keep);
+            continue;
+        }
+        if (fs::file_size(copy, ec) != group.size || ec || !SameContents(keep, copy, group.size)) {
+            fail("no longer identical to " + keep);
+            continue;
+        }
+        if (dryRun) {
+            result.bytesFreed += group.size;
+            result.replaced++;
+            continue;
+        }
+
+        if (action == DuplicateAction::Delete) {
+            if (!fs::remove(copy, ec) || ec) {
+                fail(ec ? ec.message() : "not removed");
+                continue;
+            }
+        } else {
+            std::string temporary = copy + ".dcdupe";
+            bool made = action == DuplicateAction::HardLink
+                ? (fs::create_hard_link(keep, temporary, ec), !ec)
+                : CloneFile(keep, temporary, ec);
+            if (made && action == DuplicateAction::Reflink) {
+                fs::permissions(temporary, fs::status(copy).permissions(), ec);
+                ec.clear();
+            }
+            if (made) fs::rename(temporary, copy, ec);
+            if (!made || ec) {
+                std::error_code ignored;
+                if (made) fs::remove(temporary, ignored);
+                fail(ec.message());
+                continue;
+            }
+        }
+        result.bytesFreed += group.size;
+        result.replaced++;
+    }
+    return result;
+}
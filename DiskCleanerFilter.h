@@ -0,0 +1,451 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <deque>
+#include <unordered_map>
+#include <fstream>
+#include <algorithm>
+#include <cstdint>
+
+// =====================================================================================
+// PATH FILTER
+// =====================================================================================
+// Include/exclude rules that limit what a cleanup removes, e.g. "only *.tmp and *.log"
+// or "never *.lock". Rules are compiled once: plain names go into a hash table, "*.ext"
+// patterns into a hash table of suffixes (one lookup per suffix length in use), and
+// only what is left is matched as a glob, after a literal prefix/suffix check. Per entry
+// that is a few hash lookups instead of one match per rule.
+//
+// Pattern syntax, close to .gitignore:
+//   *.tmp  thumbs.db  cache-?  [Tt]emp*   a name at any depth (* ? [a-z] [!x] \x)
+//   build/                                 trailing slash: directories only
+//   logs/old  /logs/*.gz  src/**/obj       with a slash: a path below the root, where
+//                                          * stays within one level and ** spans any
+//   !keep.tmp                              exception to the rules before it
+// Within the include and the exclude list the last matching rule wins.
+//
+// The engine asks Decide() for every entry of a filtered directory:
+//   Keep     excluded, or not included. An excluded directory is not opened at all, and
+//            neither is one that no include rule could match anything in.
+//   Delete   the file, or the whole directory with no more checks below it (included
+//            and nothing could be excluded inside).
+//   Descend  a directory to list and filter entry by entry. It is removed afterwards
+//            only if it was included itself and everything in it went.
+// Once a directory is excluded nothing below it can be included again.
+// =====================================================================================
+
+enum class FilterDecision {
+    Keep,
+    Delete,
+    Descend
+};
+
+// Where the engine is in the tree: one per directory being filtered.
+struct FilterScope {
+    std::string relativePath;  // "a/b" below the root; only kept when there are path rules
+    bool selected = false;     // this directory, or one above it, is included
+};
+
+class PathFilter {
+public:
+#ifdef _WIN32
+    static constexpr bool DefaultIgnoreCase = true;
+#else
+    static constexpr bool DefaultIgnoreCase = false;
+#endif
+
+    explicit PathFilter(bool ignoreCase = DefaultIgnoreCase) : ignoreCase(ignoreCase) {}
+
+    // False for an empty pattern.
+    bool Include(const std::string& pattern) { return includes.Add(Fold(pattern)); }
+    bool Exclude(const std::string& pattern) { return excludes.Add(Fold(pattern)); }
+
+    // One rule per line, "include PATTERN" or "exclude PATTERN"; blank lines and lines
+    // starting with # are ignored. On a bad line nothing is added and error says why.
+    bool LoadRules(const std::string& filePath, std::string& error) {
+        std::ifstream file(filePath);
+        if (!file.is_open()) {
+            error = "cannot open " + filePath;
+            return false;
+        }
+        std::vector<std::pair<bool, std::string>> rules;
+        std::string line;
+        for (size_t number = 1; std::getline(file, line); ++number) {
+            if (!line.empty() && line.back() == '\r') line.pop_back();
+            size_t start = line.find_first_not_of(" \t");
+            if (start == std::string::npos || line[start] == '#') continue;
+            size_t space = line.find_first_of(" \t", start);
+            size_t patternStart = space == std::string::npos ? std::string::npos : line.find_first_not_of(" \t", space);
+            std::string keyword = line.substr(start, space == std::string::npos ? std::string::npos : space - start);
+            if ((keyword != "include" && keyword != "exclude") || patternStart == std::string::npos) {
+                error = filePath + ":" + std::to_string(number) + ": expected \"include PATTERN\" or \"exclude PATTERN\"";
+                return false;
+            }
+            rules.emplace_back(keyword == "include", line.substr(patternStart));
+        }
+        for (const auto& [include, pattern] : rules) {
+            if (include) Include(pattern);
+            else Exclude(pattern);
+        }
+        return true;
+    }
+
+    bool Empty() const { return includes.Size() == 0 && excludes.Size() == 0; }
+    size_t IncludeCount() const { return includes.Size(); }
+    size_t ExcludeCount() const { return excludes.Size(); }
+
+    // Scope of the cleanup root itself. With no include rules everything is included.
+    FilterScope Root() const {
+        FilterScope scope;
+        scope.selected = includes.Size() == 0;
+        return scope;
+    }
+
+    // What to do with entry name of the directory scope stands for.
+    FilterDecision Decide(const FilterScope& scope, std::string_view name, bool isDirectory) const {
+        std::string_view path = ChildPath(scope, name);
+        name = FoldView(name, 1);
+        if (excludes.Match(path, name, isDirectory) == RuleSet::Matched) return FilterDecision::Keep;
+
+        bool selected = Selected(scope, path, name, isDirectory);
+        if (!isDirectory) return selected ? FilterDecision::Delete : FilterDecision::Keep;
+        if (selected && excludes.Size() == 0 && !includes.HasNegations()) return FilterDecision::Delete;
+        if (!selected && !includes.CanMatchBelow(path)) return FilterDecision::Keep;
+        return FilterDecision::Descend;
+    }
+
+    // Scope for a directory Decide() returned Descend for.
+    FilterScope Enter(const FilterScope& scope, std::string_view name) const {
+        std::string_view path = ChildPath(scope, name);
+        FilterScope child;
+        if (excludes.NeedsPaths() || includes.NeedsPaths()) child.relativePath.assign(path.data(), path.size());
+        child.selected = Selected(scope, path, FoldView(name, 1), true);
+        return child;
+    }
+
+private:
+    // One list of rules, include or exclude.
+    class RuleSet {
+    public:
+        enum Result { None, Matched, Negated };
+
+        RuleSet() = default;
+        // The tables hold views into strings; a move keeps the deque's storage, a copy
+        // would not.
+        RuleSet(const RuleSet&) = delete;
+        RuleSet& operator=(const RuleSet&) = delete;
+        RuleSet(RuleSet&&) = default;
+        RuleSet& operator=(RuleSet&&) = default;
+
+        bool Add(std::string pattern) {
+            Rule rule;
+            if (!pattern.empty() && pattern[0] == '!') {
+                rule.negated = true;
+                pattern.erase(0, 1);
+            }
+            if (!pattern.empty() && pattern.back() == '/') {
+                rule.directoryOnly = true;
+                pattern.pop_back();
+            }
+            bool anchored = !pattern.empty() && pattern[0] == '/';
+            if (anchored) pattern.erase(0, 1);
+            if (pattern.empty()) return false;
+
+            const uint32_t index = static_cast<uint32_t>(rules.size());
+            rules.push_back(rule);
+            if (rule.negated) negations = true;
+
+            if (anchored || pattern.find('/') != std::string::npos) {
+                PathRule pathRule;
+                pathRule.index = index;
+                size_t start = 0;
+                while (start <= pattern.size()) {
+                    size_t slash = pattern.find('/', start);
+                    if (slash == std::string::npos) slash = pattern.size();
+                    if (slash > start) pathRule.segments.push_back(pattern.substr(start, slash - start));
+                    start = slash + 1;
+                }
+                if (!rule.negated) positivePaths++;
+                pathRules.push_back(std::move(pathRule));
+                return true;
+            }
+
+            if (!rule.negated) positiveNames++;
+            size_t wildcard = pattern.find_first_of("*?[\\");
+            if (wildcard == std::string::npos) {
+                names[Intern(pattern)].push_back(index);
+            } else if (pattern[0] == '*' && pattern.find_first_of("*?[\\", 1) == std::string::npos && pattern.size() > 1) {
+                // "*.log", "*~": any name ending in the rest
+                std::string_view suffix = Intern(pattern.substr(1));
+                suffixes[suffix].push_back(index);
+                suffixLengths.push_back(suffix.size());
+                std::sort(suffixLengths.begin(), suffixLengths.end());
+                suffixLengths.erase(std::unique(suffixLengths.begin(), suffixLengths.end()), suffixLengths.end());
+            } else {
+                NameGlob glob;
+                glob.index = index;
+                glob.prefix = pattern.substr(0, wildcard);
+                size_t last = pattern.find_last_of("*?]\\");
+                if (last != std::string::npos && (last == 0 || pattern[last - 1] != '\\')) {
+                    glob.suffix = pattern.substr(last + 1);
+                }
+                glob.pattern = std::move(pattern);
+                nameGlobs.push_back(std::move(glob));
+            }
+            return true;
+        }
+
+        size_t Size() const { return rules.size(); }
+        bool HasNegations() const { return negations; }
+        bool NeedsPaths() const { return !pathRules.empty(); }
+
+        // The last rule matching the entry at path (its name being name) decides.
+        Result Match(std::string_view path, std::string_view name, bool isDirectory) const {
+            int best = -1;
+            auto consider = [&](uint32_t index) {
+                if (static_cast<int>(index) > best && (isDirectory || !rules[index].directoryOnly)) {
+                    best = static_cast<int>(index);
+                }
+            };
+            auto considerAll = [&](const std::vector<uint32_t>& indices) {
+                for (auto it = indices.rbegin(); it != indices.rend(); ++it) {
+                    if (static_cast<int>(*it) <= best) break;
+                    if (isDirectory || !rules[*it].directoryOnly) {
+                        best = static_cast<int>(*it);
+                        break;
+                    }
+                }
+            };
+            auto done = [&]() { return best >= 0 && !negations; };
+
+            if (!names.empty()) {
+                auto it = names.find(name);
+                if (it != names.end()) considerAll(it->second);
+            }
+            if (!done() && !suffixes.empty()) {
+                for (size_t length : suffixLengths) {
+                    if (length > name.size()) break;
+                    auto it = suffixes.find(name.substr(name.size() - length));
+                    if (it != suffixes.end()) considerAll(it->second);
+                }
+            }
+            for (auto it = nameGlobs.rbegin(); it != nameGlobs.rend() && !done(); ++it) {
+                if (static_cast<int>(it->index) <= best) break;
+                if (!isDirectory && rules[it->index].directoryOnly) continue;
+                if (!StartsWith(name, it->prefix) || !EndsWith(name, it->suffix)) continue;
+                if (MatchSegment(it->pattern, name)) consider(it->index);
+            }
+            for (auto it = pathRules.rbegin(); it != pathRules.rend() && !done(); ++it) {
+                if (static_cast<int>(it->index) <= best) break;
+                if (!isDirectory && rules[it->index].directoryOnly) continue;
+                if (MatchPath(it->segments, 0, path)) consider(it->index);
+            }
+            if (best < 0) return None;
+            return rules[best].negated ? Negated : Matched;
+        }
+
+        // Whether a rule could match something inside the directory at path.
+        bool CanMatchBelow(std::string_view path) const {
+            if (positiveNames > 0) return true;
+            if (positivePaths == 0) return false;
+            for (const auto& pathRule : pathRules) {
+                if (!rules[pathRule.index].negated && MatchPrefix(pathRule.segments, 0, path)) return true;
+            }
+            return false;
+        }
+
+    private:
+        struct Rule {
+            bool negated = false;
+            bool directoryOnly = false;
+        };
+
+        struct NameGlob {
+            std::string pattern;
+            std::string prefix;  // literal text before the first wildcard
+            std::string suffix;  // literal text after the last one
+            uint32_t index = 0;
+        };
+
+        struct PathRule {
+            std::vector<std::string> segments;  // "**" spans any number of levels
+            uint32_t index = 0;
+        };
+
+        std::string_view Intern(std::string text) {
+            strings.push_back(std::move(text));
+            return strings.back();
+        }
+
+        // path against segments[i...], one level per segment.
+        static bool MatchPath(const std::vector<std::string>& segments, size_t i, std::string_view path) {
+            if (i == segments.size()) return path.empty();
+            if (segments[i] == "**") {
+                if (i + 1 == segments.size()) return true;
+                while (true) {
+                    if (MatchPath(segments, i + 1, path)) return true;
+                    size_t slash = path.find('/');
+                    if (slash == std::string_view::npos) return false;
+                    path.remove_prefix(slash + 1);
+                }
+            }
+            if (path.empty()) return false;
+            size_t slash = path.find('/');
+            std::string_view level = path.substr(0, slash);
+            if (!MatchSegment(segments[i], level)) return false;
+            return MatchPath(segments, i + 1, slash == std::string_view::npos ? std::string_view() : path.substr(slash + 1));
+        }
+
+        // Whether the directory at path is on the way to something segments can match.
+        static bool MatchPrefix(const std::vector<std::string>& segments, size_t i, std::string_view path) {
+            if (path.empty()) return i < segments.size();
+            if (i == segments.size()) return false;
+            if (segments[i] == "**") return true;
+            size_t slash = path.find('/');
+            if (!MatchSegment(segments[i], path.substr(0, slash))) return false;
+            return MatchPrefix(segments, i + 1, slash == std::string_view::npos ? std::string_view() : path.substr(slash + 1));
+        }
+
+        std::vector<Rule> rules;
+        std::deque<std::string> strings;  // owns the keys of the tables below
+        std::unordered_map<std::string_view, std::vector<uint32_t>> names;
+        std::unordered_map<std::string_view, std::vector<uint32_t>> suffixes;
+        std::vector<size_t> suffixLengths;  // ascending
+        std::vector<NameGlob> nameGlobs;
+        std::vector<PathRule> pathRules;
+        size_t positiveNames = 0;
+        size_t positivePaths = 0;
+        bool negations = false;
+    };
+
+    // A glob against one name: * and ? never match '/', [...] is a class ([!...] or
+    // [^...] negated, a-z ranges), \ takes the next character literally. Backtracks to
+    // the last * only, so it is linear in practice.
+    static bool MatchSegment(std::string_view pattern, std::string_view text) {
+        size_t p = 0, t = 0;
+        size_t starP = std::string_view::npos, starT = 0;
+        while (t < text.size()) {
+            if (p < pattern.size()) {
+                char c = pattern[p];
+                if (c == '*') {
+                    starP = ++p;
+                    starT = t;
+                    continue;
+                }
+                if (c == '?' && text[t] != '/') {
+                    p++;
+                    t++;
+                    continue;
+                }
+                if (c == '[') {
+                    size_t next;
+                    int matched = MatchClass(pattern, p, text[t], next);
+                    if (matched > 0) {
+                        p = next;
+                        t++;
+                        continue;
+                    }
+                    if (matched < 0 && text[t] == '[') {  // no closing ']': a literal '['
+                        p++;
+                        t++;
+                        continue;
+                    }
+                } else if (c == '\\' && p + 1 < pattern.size()) {
+                    if (pattern[p + 1] == text[t]) {
+                        p += 2;
+                        t++;
+                        continue;
+                    }
+                } else if (c != '?' && c == text[t]) {
+                    p++;
+                    t++;
+                    continue;
+                }
+            }
+            if (starP == std::string_view::npos || text[starT] == '/') return false;
+            p = starP;
+            t = ++starT;
+        }
+        while (p < pattern.size() && pattern[p] == '*') p++;
+        return p == pattern.size();
+    }
+
+    // 1 if c is in the class starting at pattern[p] (next is past its ']'), 0 if not,
+    // -1 if there is no closing ']'.
+    static int MatchClass(std::string_view pattern, size_t p, char c, size_t& next) {
+        size_t i = p + 1;
+        bool negate = i < pattern.size() && (pattern[i] == '!' || pattern[i] == '^');
+        if (negate) i++;
+        bool found = false;
+        bool first = true;
+        for (; i < pattern.size(); ++i) {
+            if (pattern[i] == ']' && !first) {
+                next = i + 1;
+                return found != negate ? 1 : 0;
+            }
+            first = false;
+            char low = pattern[i];
+            if (low == '\\' && i + 1 < pattern.size()) low = pattern[++i];
+            char high = low;
+            if (i + 2 < pattern.size() && pattern[i + 1] == '-' && pattern[i + 2] != ']') {
+                high = pattern[i + 2];
+                i += 2;
+            }
+            if (c >= low && c <= high) found = true;
+        }
+        return -1;
+    }
+
+    static bool StartsWith(std::string_view text, std::string_view prefix) {
+        return text.size() >= prefix.size() && text.compare(0, prefix.size(), prefix) == 0;
+    }
+
+    static bool EndsWith(std::string_view text, std::string_view suffix) {
+        return text.size() >= suffix.size() && text.compare(text.size() - suffix.size(), suffix.size(), suffix) == 0;
+    }
+
+    bool Selected(const FilterScope& scope, std::string_view path, std::string_view name, bool isDirectory) const {
+        if (includes.Size() == 0) return true;
+        switch (includes.Match(path, name, isDirectory)) {
+            case RuleSet::Matched: return true;
+            case RuleSet::Negated: return false;
+            default: return scope.selected;
+        }
+    }
+
+    // "dir/name" (case-folded) in a per-thread buffer; empty when no rule needs paths.
+    std::string_view ChildPath(const FilterScope& scope, std::string_view name) const {
+        if (!includes.NeedsPaths() && !excludes.NeedsPaths()) return {};
+        thread_local std::string buffer;
+        buffer.assign(scope.relativePath);
+        if (!buffer.empty()) buffer += '/';
+        buffer.append(name.data(), name.size());
+        if (ignoreCase) FoldInPlace(buffer);
+        return buffer;
+    }
+
+    std::string_view FoldView(std::string_view text, int slot) const {
+        if (!ignoreCase) return text;
+        thread_local std::string buffers[2];
+        buffers[slot].assign(text.data(), text.size());
+        FoldInPlace(buffers[slot]);
+        return buffers[slot];
+    }
+
+    std::string Fold(std::string text) const {
+        if (ignoreCase) FoldInPlace(text);
+        return text;
+    }
+
+    static void FoldInPlace(std::string& text) {
+        for (char& c : text) {
+            if (c >= 'A' && c <= 'Z') c = static_cast<char>(c - 'A' + 'a');
+        }
+    }
+
+    bool ignoreCase;
+    RuleSet includes;
+    RuleSet excludes;
+};
@@ -0,0 +1,212 @@
+#pragma once
+
+// =====================================================================================
+// IO_URING
+// =====================================================================================
+// Minimal io_uring wrapper on raw syscalls (no liburing dependency), just enough to
+// submit batches of STATX/UNLINKAT and reap their completions. Only compiled on Linux
+// with kernel headers that know those opcodes; DISKCLEANER_HAS_IO_URING tells callers
+// whether it is there. IoUring::IsSupported() additionally probes the running kernel,
+// which may be too old or have io_uring disabled (containers, sysctl).
+// =====================================================================================
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+// The opcodes are enumerators, not macros; IORING_FEAT_EXT_ARG arrived in the same
+// 5.11 header as IORING_OP_UNLINKAT and sqe->unlink_flags.
+#ifdef IORING_FEAT_EXT_ARG
+#define DISKCLEANER_HAS_IO_URING 1
+#endif
+#endif
+#endif
+
+#ifdef DISKCLEANER_HAS_IO_URING
+
+#include <cstdint>
+#include <cstring>
+#include <cerrno>
+#include <vector>
+#include <algorithm>
+#include <initializer_list>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+class IoUring {
+public:
+    explicit IoUring(unsigned entries) {
+        io_uring_params params;
+        std::memset(&params, 0, sizeof(params));
+
+        fd = static_cast<int>(::syscall(__NR_io_uring_setup, entries, &params));
+        if (fd < 0) return;
+
+        sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        bool singleMmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+        if (singleMmap) {
+            sqRingSize = cqRingSize = (std::max)(sqRingSize, cqRingSize);
+        }
+
+        sqRing = ::mmap(nullptr, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+        if (sqRing == MAP_FAILED) {
+            sqRing = nullptr;
+            Close();
+            return;
+        }
+        if (singleMmap) {
+            cqRing = sqRing;
+        } else {
+            cqRing = ::mmap(nullptr, cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+            if (cqRing == MAP_FAILED) {
+                cqRing = nullptr;
+                Close();
+                return;
+            }
+        }
+
+        sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+        void* sqeMemory = ::mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+        if (sqeMemory == MAP_FAILED) {
+            Close();
+            return;
+        }
+        sqes = static_cast<io_uring_sqe*>(sqeMemory);
+
+        auto* sq = static_cast<char*>(sqRing);
+        sqHead = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+        sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        sqMask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+        sqEntries = params.sq_entries;
+
+        auto* cq = static_cast<char*>(cqRing);
+        cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        cqMask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+
+        localTail = *sqTail;
+        ready = true;
+    }
+
+    ~IoUring() {
+        Close();
+    }
+
+    IoUring(const IoUring&) = delete;
+    IoUring& operator=(const IoUring&) = delete;
+
+    bool IsReady() const { return ready; }
+    unsigned Capacity() const { return sqEntries; }
+
+    // True when the running kernel accepts io_uring and implements every opcode given.
+    static bool IsSupported(std::initializer_list<uint8_t> opcodes) {
+        IoUring ring(4);
+        if (!ring.IsReady()) return false;
+
+        std::vector<char> buffer(sizeof(io_uring_probe) + 256 * sizeof(io_uring_probe_op), 0);
+        auto* probe = reinterpret_cast<io_uring_probe*>(buffer.data());
+        if (::syscall(__NR_io_uring_register, ring.fd, IORING_REGISTER_PROBE, probe, 256) < 0) return false;
+
+        for (uint8_t op : opcodes) {
+            if (op > probe->last_op || !(probe->ops[op].flags & IO_URING_OP_SUPPORTED)) return false;
+        }
+        return true;
+    }
+
+    // Submission slots NextSqe() can still hand out before a SubmitAndWait().
+    unsigned SpaceLeft() const {
+        return sqEntries - (localTail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE));
+    }
+
+    // Next free submission slot, zeroed; nullptr when the queue is full.
+    io_uring_sqe* NextSqe() {
+        unsigned head = __atomic_load_n(sqHead, __ATOMIC_ACQUIRE);
+        if (localTail - head >= sqEntries) return nullptr;
+
+        unsigned index = localTail & sqMask;
+        io_uring_sqe* sqe = &sqes[index];
+        std::memset(sqe, 0, sizeof(*sqe));
+        sqArray[index] = index;
+        localTail++;
+        pendingSubmit++;
+        return sqe;
+    }
+
+    // Publishes everything queued since the last call and blocks until at least
+    // waitFor completions are available. Returns false on a hard error.
+    bool SubmitAndWait(unsigned waitFor) {
+        __atomic_store_n(sqTail, localTail, __ATOMIC_RELEASE);
+        unsigned toSubmit = pendingSubmit;
+        pendingSubmit = 0;
+
+        while (true) {
+            long r = ::syscall(__NR_io_uring_enter, fd, toSubmit, waitFor, waitFor ? IORING_ENTER_GETEVENTS : 0, nullptr, 0);
+            if (r >= 0) {
+                submitCalls++;
+                return true;
+            }
+            if (errno != EINTR) return false;
+        }
+    }
+
+    // Calls onCompletion(userData, result) for every available completion.
+    template <typename Callback>
+    unsigned Reap(Callback&& onCompletion) {
+        unsigned head = *cqHead;
+        unsigned tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+        unsigned count = 0;
+
+        while (head != tail) {
+            const io_uring_cqe& cqe = cqes[head & cqMask];
+            onCompletion(cqe.user_data, cqe.res);
+            head++;
+            count++;
+        }
+        __atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+        return count;
+    }
+
+    uint64_t SubmitCalls() const { return submitCalls; }
+
+private:
+    void Close() {
+        if (sqes) ::munmap(sqes, sqesSize);
+        if (cqRing && cqRing != sqRing) ::munmap(cqRing, cqRingSize);
+        if (sqRing) ::munmap(sqRing, sqRingSize);
+        if (fd >= 0) ::close(fd);
+        sqes = nullptr;
+        sqRing = cqRing = nullptr;
+        fd = -1;
+        ready = false;
+    }
+
+    int fd = -1;
+    bool ready = false;
+
+    void* sqRing = nullptr;
+    void* cqRing = nullptr;
+    size_t sqRingSize = 0;
+    size_t cqRingSize = 0;
+    size_t sqesSize = 0;
+
+    unsigned* sqHead = nullptr;
+    unsigned* sqTail = nullptr;
+    unsigned* sqArray = nullptr;
+    unsigned sqMask = 0;
+    unsigned sqEntries = 0;
+    io_uring_sqe* sqes = nullptr;
+
+    unsigned* cqHead = nullptr;
+    unsigned* cqTail = nullptr;
+    unsigned cqMask = 0;
+    io_uring_cqe* cqes = nullptr;
+
+    unsigned localTail = 0;
+    unsigned pendingSubmit = 0;
+    uint64_t submitCalls = 0;
+};
+
+#endif
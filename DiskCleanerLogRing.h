@@ -0,0 +1,102 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+// =====================================================================================
+// LOG RING
+// =====================================================================================
+// Bounded multi-producer, single-consumer queue (per-slot sequence numbers, after
+// Vyukov's bounded queue). Workers push formatted log lines without taking a lock or
+// waiting for the UI; the UI thread drains everything that is ready on a timer and
+// appends it to the results view in one go. When the ring is full a push fails and is
+// counted as dropped instead of blocking the worker.
+//
+// Push is lock-free: a producer claims a slot with one CAS on head and publishes it by
+// bumping the slot's sequence. Lines from one producer come out in the order pushed;
+// lines from different producers are ordered by when they claimed their slot.
+// =====================================================================================
+
+template <typename T>
+class MpscRing {
+public:
+    // capacity is rounded up to a power of two.
+    explicit MpscRing(size_t capacity) {
+        size_t rounded = 2;
+        while (rounded < capacity) rounded <<= 1;
+        mask = rounded - 1;
+        slots.reset(new Slot[rounded]);
+        for (size_t i = 0; i < rounded; ++i) {
+            slots[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    MpscRing(const MpscRing&) = delete;
+    MpscRing& operator=(const MpscRing&) = delete;
+
+    // Any thread. False (and one more drop counted) when the ring is full.
+    bool TryPush(T value) {
+        size_t position = head.load(std::memory_order_relaxed);
+        Slot* slot;
+        while (true) {
+            slot = &slots[position & mask];
+            size_t sequence = slot->sequence.load(std::memory_order_acquire);
+            intptr_t difference = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position);
+            if (difference == 0) {
+                if (head.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) break;
+            } else if (difference < 0) {
+                dropped.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            } else {
+                position = head.load(std::memory_order_relaxed);
+            }
+        }
+        slot->value = std::move(value);
+        slot->sequence.store(position + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer thread only.
+    bool TryPop(T& out) {
+        Slot& slot = slots[tail & mask];
+        if (slot.sequence.load(std::memory_order_acquire) != tail + 1) return false;
+        out = std::move(slot.value);
+        slot.sequence.store(tail + mask + 1, std::memory_order_release);
+        tail++;
+        return true;
+    }
+
+    // Consumer thread only. Pops up to maxItems (0 = all that are ready) into sink.
+    template <typename Sink>
+    size_t Drain(Sink&& sink, size_t maxItems = 0) {
+        size_t count = 0;
+        T value;
+        while ((maxItems == 0 || count < maxItems) && TryPop(value)) {
+            sink(std::move(value));
+            count++;
+        }
+        return count;
+    }
+
+    size_t Capacity() const { return mask + 1; }
+
+    uint64_t Dropped() const { return dropped.load(std::memory_order_relaxed); }
+
+    // Drops since the last call, for a "N lines dropped" note.
+    uint64_t TakeDropped() { return dropped.exchange(0, std::memory_order_relaxed); }
+
+private:
+    struct Slot {
+        std::atomic<size_t> sequence{0};
+        T value{};
+    };
+
+    std::unique_ptr<Slot[]> slots;
+    size_t mask = 0;
+    alignas(64) std::atomic<size_t> head{0};
+    alignas(64) size_t tail = 0;
+    alignas(64) std::atomic<uint64_t> dropped{0};
+};
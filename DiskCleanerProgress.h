@@ -0,0 +1,203 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+
+// =====================================================================================
+// PROGRESS
+// =====================================================================================
+// Workers add what they processed to ProgressCounters: bytes, files and directories
+// plus finished items, each thread into its own cache-line-sized shard with relaxed
+// adds, so reporting progress never contends and never waits for anyone. A
+// ProgressSampler sums the shards a few times per second and publishes an immutable
+// ProgressSnapshot with the totals and smoothed rates; the UI reads the latest snapshot
+// on its own timer. Nothing on the worker side touches a window.
+//
+// Sums are not a consistent cut across shards (a batch may be half counted), which is
+// fine for a progress bar; the final sample after Stop() sees everything.
+// =====================================================================================
+
+struct ProgressTotals {
+    uint64_t bytes = 0;
+    uint64_t files = 0;
+    uint64_t directories = 0;
+    uint64_t items = 0;
+};
+
+class ProgressCounters {
+public:
+    static constexpr size_t Shards = 16;
+
+    // Any thread.
+    void Add(uint64_t bytes, uint64_t files, uint64_t directories) {
+        Shard& shard = shards[ShardIndex()];
+        if (bytes) shard.bytes.fetch_add(bytes, std::memory_order_relaxed);
+        if (files) shard.files.fetch_add(files, std::memory_order_relaxed);
+        if (directories) shard.directories.fetch_add(directories, std::memory_order_relaxed);
+    }
+
+    // Any thread, once per finished cleanup target (or sized item).
+    void ItemDone() {
+        shards[ShardIndex()].items.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    ProgressTotals Sum() const {
+        ProgressTotals totals;
+        for (const auto& shard : shards) {
+            totals.bytes += shard.bytes.load(std::memory_order_relaxed);
+            totals.files += shard.files.load(std::memory_order_relaxed);
+            totals.directories += shard.directories.load(std::memory_order_relaxed);
+            totals.items += shard.items.load(std::memory_order_relaxed);
+        }
+        return totals;
+    }
+
+private:
+    struct alignas(64) Shard {
+        std::atomic<uint64_t> bytes{0};
+        std::atomic<uint64_t> files{0};
+        std::atomic<uint64_t> directories{0};
+        std::atomic<uint64_t> items{0};
+    };
+
+    // Threads are spread over the shards in the order they first report.
+    static size_t ShardIndex() {
+        static std::atomic<size_t> nextIndex{0};
+        thread_local size_t index = nextIndex.fetch_add(1, std::memory_order_relaxed) % Shards;
+        return index;
+    }
+
+    Shard shards[Shards];
+};
+
+struct ProgressSnapshot {
+    ProgressTotals done;
+    uint64_t totalBytes = 0;  // pre-scan estimate, 0 when unknown
+    uint64_t totalItems = 0;
+    double seconds = 0;
+    double bytesPerSecond = 0;
+    double filesPerSecond = 0;
+    uint64_t sequence = 0;    // bumped by every sample
+    bool finished = false;
+
+    // 0..1 by bytes against the estimate when there is one, by items otherwise. Bytes
+    // can overshoot a stale estimate, so they never claim more than 99% before every
+    // item is done.
+    double Fraction() const {
+        if (finished) return 1.0;
+        double byItems = totalItems ? static_cast<double>(done.items) / totalItems : 0.0;
+        if (totalBytes == 0) return byItems;
+        double byBytes = static_cast<double>(done.bytes) / totalBytes;
+        if (done.items < totalItems && byBytes > 0.99) byBytes = 0.99;
+        return byBytes < byItems ? byItems : byBytes;
+    }
+};
+
+class ProgressSampler {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    ProgressSampler(std::shared_ptr<const ProgressCounters> counters, uint64_t totalBytes, uint64_t totalItems,
+                    Clock::duration interval = std::chrono::milliseconds(250))
+        : counters(std::move(counters)), totalBytes(totalBytes), totalItems(totalItems), interval(interval),
+          start(Clock::now()), lastSampleTime(start) {
+        std::atomic_store(&latest, std::make_shared<const ProgressSnapshot>(Build(false)));
+    }
+
+    ~ProgressSampler() { Stop(); }
+
+    ProgressSampler(const ProgressSampler&) = delete;
+    ProgressSampler& operator=(const ProgressSampler&) = delete;
+
+    // Samples every interval on a thread of its own until Stop().
+    void Start() {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (thread.joinable()) return;
+        stopping = false;
+        thread = std::thread([this]() {
+            std::unique_lock<std::mutex> lock(mutex);
+            while (!wake.wait_for(lock, interval, [this]() { return stopping; })) {
+                lock.unlock();
+                Sample();
+                lock.lock();
+            }
+        });
+    }
+
+    // Stops the thread and publishes a final snapshot marked finished.
+    void Stop() {
+        std::thread stopped;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+            stopped = std::move(thread);
+        }
+        wake.notify_all();
+        if (stopped.joinable()) stopped.join();
+        Publish(true);
+    }
+
+    void Sample() { Publish(false); }
+
+    // Any thread; never blocks on the workers.
+    std::shared_ptr<const ProgressSnapshot> Latest() const {
+        return std::atomic_load(&latest);
+    }
+
+private:
+    void Publish(bool finished) {
+        std::lock_guard<std::mutex> lock(sampleMutex);
+        std::atomic_store(&latest, std::make_shared<const ProgressSnapshot>(Build(finished)));
+    }
+
+    // Rates are per sample interval, smoothed so a bar that updates four times per
+    // second does not flicker between neighbours.
+    ProgressSnapshot Build(bool finished) {
+        auto now = Clock::now();
+        ProgressSnapshot snapshot;
+        snapshot.done = counters->Sum();
+        snapshot.totalBytes = totalBytes;
+        snapshot.totalItems = totalItems;
+        snapshot.seconds = std::chrono::duration<double>(now - start).count();
+        snapshot.sequence = ++sequence;
+        snapshot.finished = finished;
+
+        double elapsed = std::chrono::duration<double>(now - lastSampleTime).count();
+        if (elapsed > 0 && sequence > 1) {
+            double bytesRate = (snapshot.done.bytes - lastTotals.bytes) / elapsed;
+            double filesRate = (snapshot.done.files - lastTotals.files) / elapsed;
+            bytesPerSecond = sequence > 2 ? 0.5 * bytesPerSecond + 0.5 * bytesRate : bytesRate;
+            filesPerSecond = sequence > 2 ? 0.5 * filesPerSecond + 0.5 * filesRate : filesRate;
+        }
+        snapshot.bytesPerSecond = bytesPerSecond;
+        snapshot.filesPerSecond = filesPerSecond;
+        lastTotals = snapshot.done;
+        lastSampleTime = now;
+        return snapshot;
+    }
+
+    const std::shared_ptr<const ProgressCounters> counters;
+    const uint64_t totalBytes;
+    const uint64_t totalItems;
+    const Clock::duration interval;
+    const Clock::time_point start;
+
+    std::mutex sampleMutex;  // Sample() from the thread and Stop() from the owner
+    Clock::time_point lastSampleTime;
+    ProgressTotals lastTotals;
+    double bytesPerSecond = 0;
+    double filesPerSecond = 0;
+    uint64_t sequence = 0;
+    std::shared_ptr<const ProgressSnapshot> latest;
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool stopping = false;
+    std::thread thread;
+};
@@ -0,0 +1,294 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <chrono>
+#include <sstream>
+#include <algorithm>
+#include <filesystem>
+#include <cstdlib>
+#include <cstdint>
+#include <cerrno>
+
+// =====================================================================================
+// RETENTION
+// =====================================================================================
+// Per-item rules for log directories and the like, instead of wiping them completely:
+//   days=N    only files last written more than N days ago are removed
+//   keep=K    the newest K files of every directory stay
+//   size=X    the newest files of every directory stay while they add up to at most X
+//             bytes (KB/MB/GB/TB); the first that does not fit ends the run
+// A file stays if any rule keeps it, so "days=30,keep=5" removes month-old logs but never
+// the last five of a directory.
+//
+// The engine evaluates the rules while it lists a directory, from the stat it takes of
+// every file anyway. A RetentionSelector holds only the files some keep rule still
+// covers, in a min-heap per rule with the oldest on top: a newer file pushes the oldest
+// out once there are more than K (or more than X bytes), and a file out of every heap is
+// released for deletion right away. A directory of 100k logs with keep=10 holds 11
+// names at a time and is never sorted. With only days=N nothing is held at all.
+//
+// Directories themselves are never removed under a retention policy.
+// =====================================================================================
+
+// A whole decimal number no larger than max. "abc", "8x", "-5", " 5", "" and values out
+// of range fail instead of turning into 0, wrapping around or being truncated.
+inline bool ParseWholeNumber(const std::string& text, unsigned long long max, unsigned long long& out) {
+    const char* value = text.c_str();
+    if (*value < '0' || *value > '9') return false;
+    char* end = nullptr;
+    errno = 0;
+    unsigned long long number = std::strtoull(value, &end, 10);
+    if (errno == ERANGE || *end != '\0' || number > max) return false;
+    out = number;
+    return true;
+}
+
+// "512", "64KB", "2GB", "1t": a byte count with an optional binary unit.
+inline bool ParseByteCount(const std::string& text, uint64_t& out) {
+    const char* value = text.c_str();
+    if (*value < '0' || *value > '9') return false;  // strtoull would take "-5" and " 5"
+    char* end = nullptr;
+    errno = 0;
+    unsigned long long number = std::strtoull(value, &end, 10);
+    if (errno == ERANGE) return false;
+    std::string suffix(end);
+    std::transform(suffix.begin(), suffix.end(), suffix.begin(),
+                   [](char c) { return static_cast<char>(c >= 'a' && c <= 'z' ? c - 'a' + 'A' : c); });
+    if (!suffix.empty() && suffix.back() == 'B') suffix.pop_back();
+    static const std::string units = "KMGT";
+    size_t shift = 0;
+    if (suffix.size() == 1 && units.find(suffix[0]) != std::string::npos) {
+        shift = 10 * (units.find(suffix[0]) + 1);
+    } else if (!suffix.empty()) {
+        return false;
+    }
+    if (shift && number > (UINT64_MAX >> shift)) return false;
+    out = static_cast<uint64_t>(number) << shift;
+    return true;
+}
+
+struct RetentionPolicy {
+    // Limits of days= and keep=. 100,000 days keep the cutoff in the int64_t nanoseconds
+    // of EntryStat::mtime; more than 100 million files per directory is a typo.
+    static constexpr unsigned MaxDays = 100000;
+    static constexpr size_t MaxKeep = 100000000;
+
+    unsigned olderThanDays = 0;    // 0: any age
+    size_t keepNewest = 0;         // per directory, 0: no count kept
+    uint64_t keepNewestBytes = 0;  // per directory, 0: no size kept
+
+    bool Active() const { return olderThanDays || keepNewest || keepNewestBytes; }
+
+    // "days=30,keep=10,size=2GB", empty when inactive.
+    std::string ToString() const {
+        std::ostringstream out;
+        const char* separator = "";
+        if (olderThanDays) {
+            out << "days=" << olderThanDays;
+            separator = ",";
+        }
+        if (keepNewest) {
+            out << separator << "keep=" << keepNewest;
+            separator = ",";
+        }
+        if (keepNewestBytes) {
+            static const char* units[] = {"", "KB", "MB", "GB", "TB"};
+            uint64_t value = keepNewestBytes;
+            size_t unit = 0;
+            while (unit + 1 < 5 && value % 1024 == 0) {
+                value /= 1024;
+                unit++;
+            }
+            out << separator << "size=" << value << units[unit];
+        }
+        return out.str();
+    }
+
+    // Inverse of ToString(); an empty string is an inactive policy. False, and out left
+    // alone, on anything it does not understand.
+    static bool Parse(const std::string& text, RetentionPolicy& out) {
+        RetentionPolicy policy;
+        std::istringstream in(text);
+        std::string token;
+        while (std::getline(in, token, ',')) {
+            size_t equals = token.find('=');
+            if (equals == std::string::npos) return false;
+            std::string key = token.substr(0, equals);
+            std::string value = token.substr(equals + 1);
+            unsigned long long number = 0;
+            if (key == "days") {
+                if (!ParseWholeNumber(value, MaxDays, number)) return false;
+                policy.olderThanDays = static_cast<unsigned>(number);
+            } else if (key == "keep") {
+                if (!ParseWholeNumber(value, MaxKeep, number)) return false;
+                policy.keepNewest = static_cast<size_t>(number);
+            } else if (key == "size") {
+                if (!ParseByteCount(value, policy.keepNewestBytes)) return false;
+            } else {
+                return false;
+            }
+        }
+        out = policy;
+        return true;
+    }
+};
+
+// Current time in the unit of EntryStat::mtime: nanoseconds since the Unix epoch on
+// POSIX, ticks of the file clock converted to nanoseconds on Windows.
+inline int64_t RetentionNow() {
+#ifdef _WIN32
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::filesystem::file_time_type::clock::now().time_since_epoch()).count();
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+#endif
+}
+
+struct RetentionCandidate {
+    std::string name;
+    int64_t mtime = 0;
+    uintmax_t size = 0;
+};
+
+// Streaming selection over the files of one directory. Offer() every file in listing
+// order; release(candidate) is called for each file that is certain to go, possibly
+// from within Offer(). Finish() when the listing is done.
+class RetentionSelector {
+public:
+    RetentionSelector(const RetentionPolicy& policy, int64_t now)
+        : policy(policy),
+          cutoff(policy.olderThanDays
+                     ? now - static_cast<int64_t>((std::min)(policy.olderThanDays, RetentionPolicy::MaxDays)) * 86400 * 1000000000LL
+                     : 0) {}
+
+    template <typename Release>
+    void Offer(std::string_view name, int64_t mtime, uintmax_t size, Release&& release) {
+        if (!policy.keepNewest && !policy.keepNewestBytes) {
+            if (Expired(mtime)) release(RetentionCandidate{std::string(name), mtime, size});
+            else kept++;
+            return;
+        }
+
+        uint32_t id = Allocate(name, mtime, size);
+        // Once a file has fallen out of the size budget, nothing older can be in it.
+        bool bytesRule = policy.keepNewestBytes && (!bytesDropped || !Older(slots[id], bytesFloor));
+        slots[id].holders = (policy.keepNewest ? 1 : 0) + (bytesRule ? 1 : 0);
+        if (!slots[id].holders) {
+            slots[id].holders = 1;
+            Drop(id, release);
+            return;
+        }
+        if (policy.keepNewest) {
+            Push(countHeap, id);
+            if (countHeap.size() > policy.keepNewest) Drop(Pop(countHeap), release);
+        }
+        if (bytesRule) {
+            Push(bytesHeap, id);
+            bytesHeld += size;
+            while (bytesHeld > policy.keepNewestBytes && !bytesHeap.empty()) {
+                uint32_t oldest = Pop(bytesHeap);
+                bytesHeld -= slots[oldest].candidate.size;
+                if (!bytesDropped || Older(bytesFloor, slots[oldest])) bytesFloor = Order{slots[oldest].candidate.mtime, slots[oldest].sequence};
+                bytesDropped = true;
+                Drop(oldest, release);
+            }
+        }
+    }
+
+    // Files that stay in this directory; the selector is empty again afterwards.
+    size_t Finish() {
+        size_t total = kept + (slots.size() - freeSlots.size());
+        slots.clear();
+        freeSlots.clear();
+        countHeap.clear();
+        bytesHeap.clear();
+        bytesHeld = 0;
+        bytesDropped = false;
+        kept = 0;
+        sequence = 0;
+        return total;
+    }
+
+    // Most files held at once, for the benchmark.
+    size_t PeakHeld() const { return peakHeld; }
+
+private:
+    struct Slot {
+        RetentionCandidate candidate;
+        uint64_t sequence = 0;  // listing order, breaks ties between equal mtimes
+        int holders = 0;        // heaps still holding it
+    };
+
+    bool Expired(int64_t mtime) const { return !policy.olderThanDays || mtime < cutoff; }
+
+    uint32_t Allocate(std::string_view name, int64_t mtime, uintmax_t size) {
+        uint32_t id;
+        if (!freeSlots.empty()) {
+            id = freeSlots.back();
+            freeSlots.pop_back();
+        } else {
+            id = static_cast<uint32_t>(slots.size());
+            slots.emplace_back();
+        }
+        Slot& slot = slots[id];
+        slot.candidate.name.assign(name.data(), name.size());
+        slot.candidate.mtime = mtime;
+        slot.candidate.size = size;
+        slot.sequence = sequence++;
+        peakHeld = (std::max)(peakHeld, slots.size() - freeSlots.size());
+        return id;
+    }
+
+    struct Order {
+        int64_t mtime = 0;
+        uint64_t sequence = 0;
+    };
+
+    static bool Older(const Order& x, const Order& y) {
+        return x.mtime != y.mtime ? x.mtime < y.mtime : x.sequence < y.sequence;
+    }
+    static bool Older(const Slot& x, const Order& y) { return Older(Order{x.candidate.mtime, x.sequence}, y); }
+    static bool Older(const Order& x, const Slot& y) { return Older(x, Order{y.candidate.mtime, y.sequence}); }
+    static bool Older(const Slot& x, const Slot& y) { return Older(x, Order{y.candidate.mtime, y.sequence}); }
+
+    // Heaps keep the oldest on top.
+    bool Newer(uint32_t a, uint32_t b) const { return Older(slots[b], slots[a]); }
+
+    void Push(std::vector<uint32_t>& heap, uint32_t id) {
+        heap.push_back(id);
+        std::push_heap(heap.begin(), heap.end(), [this](uint32_t a, uint32_t b) { return Newer(a, b); });
+    }
+
+    uint32_t Pop(std::vector<uint32_t>& heap) {
+        std::pop_heap(heap.begin(), heap.end(), [this](uint32_t a, uint32_t b) { return Newer(a, b); });
+        uint32_t id = heap.back();
+        heap.pop_back();
+        return id;
+    }
+
+    template <typename Release>
+    void Drop(uint32_t id, Release& release) {
+        Slot& slot = slots[id];
+        if (--slot.holders > 0) return;
+        if (Expired(slot.candidate.mtime)) release(std::move(slot.candidate));
+        else kept++;
+        slot.candidate.name.clear();
+        freeSlots.push_back(id);
+    }
+
+    const RetentionPolicy policy;
+    const int64_t cutoff;
+    std::vector<Slot> slots;
+    std::vector<uint32_t> freeSlots;
+    std::vector<uint32_t> countHeap;
+    std::vector<uint32_t> bytesHeap;
+    uint64_t bytesHeld = 0;
+    Order bytesFloor;           // newest file the size rule has let go
+    bool bytesDropped = false;
+    size_t kept = 0;  // released by every heap but too young to go
+    uint64_t sequence = 0;
+    size_t peakHeld = 0;
+};
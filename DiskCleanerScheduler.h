@@ -0,0 +1,312 @@
+#pragma once
+
+#include <deque>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <chrono>
+#include <algorithm>
+#include <cstdint>
+
+#include "DiskCleanerTrace.h"
+
+// =====================================================================================
+// TASK SCHEDULER
+// =====================================================================================
+// One fixed set of worker threads for the whole process, shared by sizing and deletion
+// instead of every item and every engine starting its own threads.
+//
+// Tasks are submitted through a TaskGroup, normally one per cleanup item or per engine
+// run. Each group has its own FIFO and workers take one task at a time from the groups
+// in round-robin order, so an item that queues 10,000 batches does not starve an item
+// that queued 10. Tasks may create groups and submit more tasks; TaskGroup::Wait() on a
+// worker thread runs the group's queued tasks itself instead of blocking, so nesting
+// cannot deadlock even with a single worker.
+// =====================================================================================
+
+class TaskScheduler;
+
+struct SchedulerStats {
+    size_t workers = 0;
+    size_t queued = 0;       // tasks waiting right now
+    size_t peakQueued = 0;
+    size_t running = 0;
+    uint64_t tasksRun = 0;
+    double busySeconds = 0;  // summed over workers
+    double elapsedSeconds = 0;
+
+    double Utilization() const {
+        return workers && elapsedSeconds > 0 ? busySeconds / (workers * elapsedSeconds) : 0;
+    }
+};
+
+class TaskScheduler {
+public:
+    explicit TaskScheduler(size_t workerCount = 0) : startTime(std::chrono::steady_clock::now()) {
+        if (workerCount == 0) {
+            workerCount = (std::max)(1u, std::thread::hardware_concurrency());
+        }
+        for (size_t i = 0; i < workerCount; ++i) {
+            workers.emplace_back([this]() { WorkerLoop(); });
+        }
+    }
+
+    ~TaskScheduler() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (auto& worker : workers) {
+            worker.join();
+        }
+    }
+
+    TaskScheduler(const TaskScheduler&) = delete;
+    TaskScheduler& operator=(const TaskScheduler&) = delete;
+
+    // Process-wide instance, sized to the number of cores.
+    static TaskScheduler& Shared() {
+        static TaskScheduler instance;
+        return instance;
+    }
+
+    size_t Workers() const { return workers.size(); }
+
+    // True on one of this scheduler's worker threads.
+    bool OnWorker() const { return currentScheduler == this; }
+
+    SchedulerStats Stats() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        SchedulerStats stats;
+        stats.workers = workers.size();
+        stats.queued = queued;
+        stats.peakQueued = peakQueued;
+        stats.running = running;
+        stats.tasksRun = tasksRun;
+        stats.busySeconds = std::chrono::duration<double>(busyTime).count();
+        stats.elapsedSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+        return stats;
+    }
+
+private:
+    friend class TaskGroup;
+
+    struct QueuedTask {
+        std::function<void()> task;
+        uint64_t queuedAt = 0;  // Tracer::Now() at submit, 0 while tracing is off
+    };
+
+    struct GroupState {
+        std::deque<QueuedTask> tasks;
+        size_t outstanding = 0;  // queued + running
+        bool inRotation = false;
+        std::condition_variable done;
+    };
+
+    void Submit(GroupState& group, std::function<void()> task) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            group.tasks.push_back({std::move(task), Tracer::Enabled() ? Tracer::Now() : 0});
+            group.outstanding++;
+            queued++;
+            peakQueued = (std::max)(peakQueued, queued);
+            if (!group.inRotation) {
+                group.inRotation = true;
+                rotation.push_back(&group);
+            }
+        }
+        wake.notify_one();
+        group.done.notify_all();  // a worker helping this group may take it
+    }
+
+    // Takes the next task of group; the lock must be held.
+    QueuedTask TakeLocked(GroupState& group) {
+        QueuedTask task = std::move(group.tasks.front());
+        group.tasks.pop_front();
+        queued--;
+        running++;
+        if (group.tasks.empty() && group.inRotation) {
+            group.inRotation = false;
+            rotation.erase(std::find(rotation.begin(), rotation.end(), &group));
+        }
+        return task;
+    }
+
+    void Execute(GroupState& group, QueuedTask& queued) {
+        // Tasks run inline by Wait() are already inside the outer task's busy time.
+        bool outermost = executeDepth++ == 0;
+        auto start = std::chrono::steady_clock::now();
+        {
+            TraceSpan span(TracePhase::Task);
+            if (queued.queuedAt && Tracer::Enabled()) {
+                uint64_t wait = Tracer::Now() - queued.queuedAt;
+                Tracer::Global().RecordLatency(TracePhase::QueueWait, wait);
+                span.SetArg(wait);
+            }
+            try {
+                queued.task();
+            } catch (...) {
+                // Tasks report their own failures; one throwing must not take a worker down.
+            }
+        }
+        auto busy = std::chrono::steady_clock::now() - start;
+        executeDepth--;
+        queued.task = nullptr;
+
+        std::lock_guard<std::mutex> lock(mutex);
+        running--;
+        tasksRun++;
+        if (outermost) busyTime += busy;
+        if (--group.outstanding == 0) {
+            group.done.notify_all();
+        }
+    }
+
+    // Runs the group's own queued tasks on the calling worker until none are left
+    // outstanding; tasks running elsewhere are waited for.
+    void HelpUntilDone(GroupState& group) {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (group.outstanding > 0) {
+            if (!group.tasks.empty()) {
+                QueuedTask task = TakeLocked(group);
+                lock.unlock();
+                Execute(group, task);
+                lock.lock();
+                continue;
+            }
+            group.done.wait(lock, [&]() { return group.outstanding == 0 || !group.tasks.empty(); });
+        }
+    }
+
+    void WaitUntilDone(GroupState& group) {
+        std::unique_lock<std::mutex> lock(mutex);
+        group.done.wait(lock, [&]() { return group.outstanding == 0; });
+    }
+
+    void WorkerLoop() {
+        currentScheduler = this;
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            wake.wait(lock, [this]() { return stopping || !rotation.empty(); });
+            if (rotation.empty()) return;
+
+            // Round robin: the group goes to the back once it has handed out a task.
+            GroupState* group = rotation.front();
+            rotation.pop_front();
+            group->inRotation = false;
+            QueuedTask task = TakeLocked(*group);
+            if (!group->tasks.empty()) {
+                group->inRotation = true;
+                rotation.push_back(group);
+            }
+
+            lock.unlock();
+            Execute(*group, task);
+            lock.lock();
+        }
+    }
+
+    mutable std::mutex mutex;
+    std::condition_variable wake;
+    std::deque<GroupState*> rotation;
+    std::vector<std::thread> workers;
+    bool stopping = false;
+
+    size_t queued = 0;
+    size_t peakQueued = 0;
+    size_t running = 0;
+    uint64_t tasksRun = 0;
+    std::chrono::steady_clock::duration busyTime{0};
+    std::chrono::steady_clock::time_point startTime;
+
+    static inline thread_local const TaskScheduler* currentScheduler = nullptr;
+    static inline thread_local int executeDepth = 0;
+};
+
+// Tasks submitted together and waited for together. The destructor waits, so a group
+// never outlives the state its tasks reference.
+class TaskGroup {
+public:
+    explicit TaskGroup(TaskScheduler& scheduler = TaskScheduler::Shared()) : scheduler(scheduler) {}
+
+    ~TaskGroup() {
+        Wait();
+    }
+
+    TaskGroup(const TaskGroup&) = delete;
+    TaskGroup& operator=(const TaskGroup&) = delete;
+
+    void Run(std::function<void()> task) {
+        scheduler.Submit(state, std::move(task));
+    }
+
+    void Wait() {
+        if (scheduler.OnWorker()) {
+            scheduler.HelpUntilDone(state);
+        } else {
+            scheduler.WaitUntilDone(state);
+        }
+    }
+
+    TaskScheduler& Scheduler() const { return scheduler; }
+
+private:
+    TaskScheduler& scheduler;
+    TaskScheduler::GroupState state;
+};
+
+// Results handed from tasks to a coordinator as they finish. Push never blocks; Pop
+// sleeps on a condition variable until a result is there (or the deadline passes), so
+// the coordinator reacts to each completion right away and is not woken otherwise.
+// Pop blocks the calling thread, so call it from outside the scheduler's workers.
+template <typename T>
+class CompletionQueue {
+public:
+    void Push(T value) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            results.push_back(std::move(value));
+        }
+        ready.notify_one();
+    }
+
+    void Pop(T& out) {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (results.empty()) {
+            ready.wait(lock);
+            wakeups++;
+        }
+        TakeLocked(out);
+    }
+
+    // False if nothing arrived before deadline.
+    bool PopUntil(T& out, std::chrono::steady_clock::time_point deadline) {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (results.empty()) {
+            if (ready.wait_until(lock, deadline) == std::cv_status::timeout && results.empty()) return false;
+            wakeups++;
+        }
+        TakeLocked(out);
+        return true;
+    }
+
+    // Times a waiting Pop was woken, spurious wakeups included.
+    uint64_t Wakeups() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return wakeups;
+    }
+
+private:
+    void TakeLocked(T& out) {
+        out = std::move(results.front());
+        results.pop_front();
+    }
+
+    mutable std::mutex mutex;
+    std::condition_variable ready;
+    std::deque<T> results;
+    uint64_t wakeups = 0;
+};
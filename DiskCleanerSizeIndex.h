@@ -0,0 +1,306 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <mutex>
+#include <fstream>
+#include <cstdint>
+#include <cstring>
+#include <system_error>
+
+#include "DiskCleanerWalker.h"
+
+// =====================================================================================
+// SIZE INDEX
+// =====================================================================================
+// Remembers, per directory, its stamp (device, inode, mtime, ctime), the bytes and
+// count of the files directly inside it and the names of its subdirectories. A refresh
+// walks the tree again but lists only directories whose stamp changed; unchanged ones
+// hand back their cached totals and subdirectories, so a rescan of a mostly idle tree
+// costs one stat per directory instead of a listing plus a stat per file.
+//
+// Limitation: a directory's mtime only moves when entries are created, removed or
+// renamed. A file that is rewritten in place (grows or shrinks) is not noticed until its
+// directory changes or the index is cleared. Good enough for cache and temp folders,
+// which churn by creating and deleting files.
+//
+// A file with several links counts once per refresh, like in a sizing walk. Each record
+// keeps the multiply-linked files of its directory and whether it counted them, so a
+// reused directory takes part in that decision again: when the directory that counted
+// a file is re-listed or gone, a reused one with another link to it counts it instead,
+// and a reused one never counts what a re-listed directory already did.
+//
+// On-disk format (native endianness, written to <file>.tmp then renamed over <file>):
+//   "DCSI" | u32 version | u64 record count
+//   per record: u32 path length, path bytes, u64 device, u64 inode, i64 mtime,
+//               i64 ctime, u64 bytes, u64 files, u32 subdir count,
+//               per subdir: u32 name length, name bytes,
+//               u32 link count, per link: u64 device, u64 inode, u64 size, u8 counted
+// =====================================================================================
+
+// One directory as of the last refresh: the files directly inside it and the names of
+// its subdirectories.
+struct IndexedDirectory {
+    uint64_t bytes = 0;
+    uint64_t files = 0;
+    int64_t mtime = 0;  // DirectoryStamp::mtime
+    std::vector<std::string> subdirs;
+};
+
+class SizeIndex {
+public:
+    static constexpr uint32_t FormatVersion = 2;
+
+    // Walks rootPath, reusing every directory whose stamp is unchanged, and returns the
+    // totals of the whole tree. Records under rootPath that were not reached any more
+    // (deleted or moved directories) are dropped, unless options.cancel stopped the walk.
+    WalkTotals Refresh(const std::string& rootPath, WalkOptions options = {}) {
+        RefreshHook hook{*this, 0};
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            hook.generation = ++generation;
+        }
+
+        ParallelWalker walker(options);
+        WalkTotals totals = walker.Walk(rootPath, [](size_t, const fs::path&, std::string_view, const EntryStat&) {}, hook);
+
+        // A stopped refresh did not reach everything, so nothing can be declared gone.
+        if (!totals.stopped) {
+            Prune(fs::path(rootPath).string(), hook.generation);
+        }
+        return totals;
+    }
+
+    // Bytes and files of the subtree at dirPath as of the last refresh, or false if the
+    // directory is not indexed.
+    bool Lookup(const std::string& dirPath, uintmax_t& bytes, uintmax_t& files) const {
+        std::lock_guard<std::mutex> lock(mutex);
+        bytes = files = 0;
+        return Aggregate(fs::path(dirPath).string(), bytes, files, 0);
+    }
+
+    // The record of exactly dirPath, or false if the directory is not indexed.
+    bool Find(const std::string& dirPath, IndexedDirectory& out) const {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = records.find(fs::path(dirPath).string());
+        if (it == records.end()) return false;
+        out.bytes = it->second.bytes;
+        out.files = it->second.files;
+        out.mtime = it->second.stamp.mtime;
+        out.subdirs = it->second.subdirs;
+        return true;
+    }
+
+    size_t Size() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return records.size();
+    }
+
+    void Clear() {
+        std::lock_guard<std::mutex> lock(mutex);
+        records.clear();
+    }
+
+    // Replaces the in-memory index with the file's contents. A missing, truncated or
+    // foreign file leaves the index empty and returns false.
+    bool Load(const std::string& filePath) {
+        std::ifstream file(filePath, std::ios::binary);
+        if (!file) return false;
+        std::string data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+        Reader in{data, 0};
+        char magic[4];
+        uint32_t version = 0;
+        uint64_t count = 0;
+        if (!in.Bytes(magic, 4) || std::memcmp(magic, "DCSI", 4) != 0) return false;
+        if (!in.Value(version) || version != FormatVersion) return false;
+        if (!in.Value(count)) return false;
+
+        std::unordered_map<std::string, Record> loaded;
+        for (uint64_t i = 0; i < count; ++i) {
+            std::string path;
+            Record record;
+            uint32_t subdirCount = 0;
+            uint32_t linkCount = 0;
+            if (!in.String(path) || !in.Value(record.stamp.device) || !in.Value(record.stamp.inode) ||
+                !in.Value(record.stamp.mtime) || !in.Value(record.stamp.ctime) || !in.Value(record.bytes) ||
+                !in.Value(record.files) || !in.Value(subdirCount)) {
+                return false;
+            }
+            for (uint32_t j = 0; j < subdirCount; ++j) {
+                std::string name;
+                if (!in.String(name)) return false;
+                record.subdirs.push_back(std::move(name));
+            }
+            if (!in.Value(linkCount)) return false;
+            for (uint32_t j = 0; j < linkCount; ++j) {
+                LinkedEntry link;
+                uint8_t counted = 0;
+                if (!in.Value(link.device) || !in.Value(link.inode) || !in.Value(link.size) || !in.Value(counted)) {
+                    return false;
+                }
+                link.counted = counted != 0;
+                record.links.push_back(link);
+            }
+            loaded[std::move(path)] = std::move(record);
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        records = std::move(loaded);
+        return true;
+    }
+
+    bool Save(const std::string& filePath) const {
+        std::string data("DCSI", 4);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            Append(data, FormatVersion);
+            Append(data, static_cast<uint64_t>(records.size()));
+            for (const auto& [path, record] : records) {
+                AppendString(data, path);
+                Append(data, record.stamp.device);
+                Append(data, record.stamp.inode);
+                Append(data, record.stamp.mtime);
+                Append(data, record.stamp.ctime);
+                Append(data, record.bytes);
+                Append(data, record.files);
+                Append(data, static_cast<uint32_t>(record.subdirs.size()));
+                for (const auto& name : record.subdirs) {
+                    AppendString(data, name);
+                }
+                Append(data, static_cast<uint32_t>(record.links.size()));
+                for (const auto& link : record.links) {
+                    Append(data, link.device);
+                    Append(data, link.inode);
+                    Append(data, link.size);
+                    Append(data, static_cast<uint8_t>(link.counted));
+                }
+            }
+        }
+
+        std::string tempPath = filePath + ".tmp";
+        {
+            std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+            if (!file) return false;
+            file.write(data.data(), static_cast<std::streamsize>(data.size()));
+            if (!file) return false;
+        }
+        std::error_code ec;
+        fs::rename(tempPath, filePath, ec);
+        return !ec;
+    }
+
+private:
+    struct Record {
+        DirectoryStamp stamp;
+        uint64_t bytes = 0;
+        uint64_t files = 0;  // bytes and files include the links counted here
+        std::vector<std::string> subdirs;
+        std::vector<LinkedEntry> links;
+        uint64_t generation = 0;
+    };
+
+    // Walker hook bound to one refresh, so records touched by it carry its generation.
+    struct RefreshHook {
+        static constexpr bool Enabled = true;
+
+        SizeIndex& index;
+        uint64_t generation;
+
+        bool TryReuse(const fs::path& dir, const DirectoryStamp& stamp, WalkTotals& own, std::vector<std::string>& subdirs,
+                      std::vector<LinkedEntry>& links) {
+            std::lock_guard<std::mutex> lock(index.mutex);
+            auto it = index.records.find(dir.string());
+            if (it == index.records.end() || !(it->second.stamp == stamp)) return false;
+
+            it->second.generation = generation;
+            own.bytes = it->second.bytes;
+            own.files = it->second.files;
+            subdirs = it->second.subdirs;
+            links = it->second.links;
+            return true;
+        }
+
+        void Store(const fs::path& dir, const DirectoryStamp& stamp, const WalkTotals& own, std::vector<std::string>& subdirs,
+                   std::vector<LinkedEntry>& links) {
+            std::lock_guard<std::mutex> lock(index.mutex);
+            Record& record = index.records[dir.string()];
+            record.stamp = stamp;
+            record.bytes = own.bytes;
+            record.files = own.files;
+            record.subdirs = std::move(subdirs);
+            record.links = std::move(links);
+            record.generation = generation;
+        }
+    };
+
+    struct Reader {
+        const std::string& data;
+        size_t offset;
+
+        bool Bytes(void* out, size_t size) {
+            if (data.size() - offset < size) return false;
+            std::memcpy(out, data.data() + offset, size);
+            offset += size;
+            return true;
+        }
+
+        template <typename T>
+        bool Value(T& out) { return Bytes(&out, sizeof(T)); }
+
+        bool String(std::string& out) {
+            uint32_t length = 0;
+            if (!Value(length) || data.size() - offset < length) return false;
+            out.assign(data.data() + offset, length);
+            offset += length;
+            return true;
+        }
+    };
+
+    template <typename T>
+    static void Append(std::string& data, T value) {
+        data.append(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+
+    static void AppendString(std::string& data, const std::string& value) {
+        Append(data, static_cast<uint32_t>(value.size()));
+        data.append(value);
+    }
+
+    static bool IsUnder(const std::string& path, const std::string& root) {
+        if (path.size() < root.size() || path.compare(0, root.size(), root) != 0) return false;
+        if (path.size() == root.size()) return true;
+        char next = path[root.size()];
+        return next == '/' || next == '\\' || root.back() == '/' || root.back() == '\\';
+    }
+
+    void Prune(const std::string& root, uint64_t refreshGeneration) {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (auto it = records.begin(); it != records.end();) {
+            if (it->second.generation < refreshGeneration && IsUnder(it->first, root)) {
+                it = records.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    // Depth guard keeps a corrupted index (or a symlink loop that got indexed) from
+    // recursing forever.
+    bool Aggregate(const std::string& dirPath, uintmax_t& bytes, uintmax_t& files, int depth) const {
+        auto it = records.find(dirPath);
+        if (it == records.end() || depth > 256) return false;
+
+        bytes += it->second.bytes;
+        files += it->second.files;
+        for (const auto& name : it->second.subdirs) {
+            Aggregate((fs::path(dirPath) / fs::path(name)).string(), bytes, files, depth + 1);
+        }
+        return true;
+    }
+
+    mutable std::mutex mutex;
+    std::unordered_map<std::string, Record> records;
+    uint64_t generation = 0;
+};
@@ -0,0 +1,146 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <filesystem>
+#include <cstdint>
+
+#include "DiskCleanerWalker.h"
+
+// =====================================================================================
+// LARGEST FILES AND DIRECTORIES
+// =====================================================================================
+// What makes up a target's total: the K largest files and the K heaviest directories,
+// found during one sizing walk. Every walker worker keeps its own pair of K-entry
+// min-heaps, so a heap update never touches another thread's memory; the heaps are
+// merged once the walk is done. A file smaller than the smallest entry of a full heap
+// is rejected by one comparison, before its path is even built, so the heaps stay at K
+// entries whether the tree holds a thousand files or fifty million.
+//
+// A directory weighs what the files directly inside it add up to. Summing whole
+// subtrees would need a running total for every directory still being walked, which
+// grows with the tree instead of with K; a directory of 40 GB of logs shows up either
+// way, a directory whose weight is spread over many subdirectories shows up as those.
+// =====================================================================================
+
+struct SizedPath {
+    uintmax_t bytes = 0;
+    std::string path;
+};
+
+// Bounded selection of the K largest entries offered, ties broken by path so results
+// do not depend on listing or thread order.
+class TopK {
+public:
+    explicit TopK(size_t k = 0) : k(k) { heap.reserve(k); }
+
+    // makePath() is only called when bytes can make it into the top K.
+    template <typename MakePath>
+    void Offer(uintmax_t bytes, MakePath&& makePath) {
+        if (k == 0) return;
+        if (heap.size() == k && bytes < heap.front().bytes) return;
+        std::string path = makePath();
+        Insert(SizedPath{bytes, std::move(path)});
+    }
+
+    void Merge(TopK&& other) {
+        for (auto& entry : other.heap) {
+            if (heap.size() < k || !Better(heap.front(), entry)) Insert(std::move(entry));
+        }
+        other.heap.clear();
+    }
+
+    // Largest first.
+    std::vector<SizedPath> Sorted() const {
+        std::vector<SizedPath> result(heap);
+        std::sort(result.begin(), result.end(), Better);
+        return result;
+    }
+
+    size_t Capacity() const { return k; }
+    size_t Size() const { return heap.size(); }
+
+private:
+    // Heap order: the worst entry on top.
+    static bool Better(const SizedPath& a, const SizedPath& b) {
+        return a.bytes != b.bytes ? a.bytes > b.bytes : a.path < b.path;
+    }
+
+    void Insert(SizedPath entry) {
+        if (heap.size() == k) {
+            if (!Better(entry, heap.front())) return;
+            std::pop_heap(heap.begin(), heap.end(), Better);
+            heap.back() = std::move(entry);
+        } else {
+            heap.push_back(std::move(entry));
+        }
+        std::push_heap(heap.begin(), heap.end(), Better);
+    }
+
+    size_t k;
+    std::vector<SizedPath> heap;
+};
+
+struct LargestEntries {
+    std::vector<SizedPath> files;        // largest first
+    std::vector<SizedPath> directories;  // by the bytes of the files directly inside
+    WalkTotals totals;                   // of the walk, as from a plain sizing walk
+};
+
+// One sizing walk of root that also keeps the k largest files and directories.
+inline LargestEntries FindLargest(const std::string& root, size_t k, WalkOptions options = {}) {
+    // Files of one directory are listed by one worker in one go, so a directory's weight
+    // is complete once that worker's next file comes from somewhere else.
+    struct alignas(64) Local {
+        TopK files, directories;
+        fs::path currentDir;
+        uintmax_t currentBytes = 0;
+
+        void FlushDirectory() {
+            if (currentBytes) directories.Offer(currentBytes, [this]() { return currentDir.string(); });
+            currentBytes = 0;
+        }
+    };
+
+    ParallelWalker walker(options);
+    std::vector<std::unique_ptr<Local>> local;
+    for (size_t i = 0; i < walker.Threads(); ++i) {
+        local.push_back(std::make_unique<Local>());
+        local.back()->files = TopK(k);
+        local.back()->directories = TopK(k);
+    }
+
+    LargestEntries result;
+    result.totals = walker.Walk(root, [&](size_t worker, const fs::path& dir, std::string_view name, const EntryStat& st) {
+        if (st.type != fs::file_type::regular) return;
+        Local& mine = *local[worker];
+        mine.files.Offer(st.size, [&]() { return (dir / fs::path(name)).string(); });
+        if (dir.native() != mine.currentDir.native()) {
+            mine.FlushDirectory();
+            mine.currentDir = dir;
+        }
+        mine.currentBytes += st.size;
+    });
+
+    TopK files(k), directories(k);
+    for (auto& mine : local) {
+        mine->FlushDirectory();
+        files.Merge(std::move(mine->files));
+        directories.Merge(std::move(mine->directories));
+    }
+    result.files = files.Sorted();
+    result.directories = directories.Sorted();
+    return result;
+}
+
+// The k largest across several targets' results, e.g. for a global list next to the
+// per-target ones.
+inline std::vector<SizedPath> MergeLargest(const std::vector<const std::vector<SizedPath>*>& lists, size_t k) {
+    TopK top(k);
+    for (const auto* list : lists) {
+        for (const auto& entry : *list) top.Offer(entry.bytes, [&]() { return entry.path; });
+    }
+    return top.Sorted();
+}
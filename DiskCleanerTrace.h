@@ -0,0 +1,316 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include <cstdint>
+
+// =====================================================================================
+// TRACING
+// =====================================================================================
+// Scoped spans around directory enumeration, stat, unlink, rmdir, sizing walks and
+// scheduler tasks, plus how long each task sat in the queue. While the tracer is off a
+// span costs one relaxed load of a flag. While it is on, every span lands in its
+// thread's own buffer: a complete event for the Chrome/Perfetto trace (up to a cap per
+// thread, the rest only counted) and a latency histogram per phase, so p50/p99 of the
+// syscalls can be set against queue wait to tell slow storage from contention.
+//
+// WriteChromeTrace() emits the trace-event JSON format that chrome://tracing and
+// ui.perfetto.dev open directly, one track per thread.
+// =====================================================================================
+
+enum class TracePhase : uint8_t {
+    Enumerate,  // one getdents64 / directory iterator step
+    Stat,
+    Unlink,
+    Rmdir,
+    Sizing,     // a whole walk
+    Task,       // a scheduler task, with its queue wait as argument
+    QueueWait,  // histogram only: overlaps the worker's previous task
+    Count
+};
+
+inline const char* TracePhaseName(TracePhase phase) {
+    switch (phase) {
+        case TracePhase::Enumerate: return "enumerate";
+        case TracePhase::Stat: return "stat";
+        case TracePhase::Unlink: return "unlink";
+        case TracePhase::Rmdir: return "rmdir";
+        case TracePhase::Sizing: return "sizing";
+        case TracePhase::Task: return "task";
+        case TracePhase::QueueWait: return "queue wait";
+        default: return "?";
+    }
+}
+
+// Durations in nanoseconds, bucketed by quarter powers of two (each bucket within 19%
+// of its values). Record is a relaxed add and safe from any thread.
+class LatencyHistogram {
+public:
+    static constexpr size_t Buckets = 160;
+
+    void Record(uint64_t nanos) {
+        counts[BucketOf(nanos)].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void Reset() {
+        for (auto& count : counts) count.store(0, std::memory_order_relaxed);
+    }
+
+    void MergeInto(std::vector<uint64_t>& merged) const {
+        merged.resize(Buckets, 0);
+        for (size_t i = 0; i < Buckets; ++i) merged[i] += counts[i].load(std::memory_order_relaxed);
+    }
+
+    uint64_t Count() const {
+        uint64_t total = 0;
+        for (const auto& count : counts) total += count.load(std::memory_order_relaxed);
+        return total;
+    }
+
+    uint64_t Percentile(double q) const {
+        std::vector<uint64_t> merged;
+        MergeInto(merged);
+        return Percentile(merged, q);
+    }
+
+    // Upper bound of the bucket holding the q-th sample of merged bucket counts.
+    static uint64_t Percentile(const std::vector<uint64_t>& merged, double q) {
+        uint64_t total = 0;
+        for (uint64_t count : merged) total += count;
+        if (total == 0) return 0;
+        uint64_t rank = static_cast<uint64_t>(q * (total - 1)) + 1, seen = 0;
+        for (size_t i = 0; i < merged.size(); ++i) {
+            seen += merged[i];
+            if (seen >= rank) return UpperBound(i);
+        }
+        return UpperBound(merged.size() - 1);
+    }
+
+    static size_t BucketOf(uint64_t nanos) {
+        if (nanos < 4) return static_cast<size_t>(nanos);
+        size_t exponent = 0;
+        for (uint64_t v = nanos; v > 1; v >>= 1) exponent++;
+        size_t index = (exponent - 1) * 4 + ((nanos >> (exponent - 2)) & 3);
+        return (std::min)(index, Buckets - 1);
+    }
+
+    static uint64_t UpperBound(size_t index) {
+        if (index < 4) return index + 1;
+        size_t exponent = index / 4 + 1;
+        return (5 + index % 4) * (uint64_t(1) << (exponent - 2));
+    }
+
+private:
+    std::atomic<uint64_t> counts[Buckets] = {};
+};
+
+struct LatencySummary {
+    uint64_t count = 0;
+    uint64_t p50Ns = 0;
+    uint64_t p99Ns = 0;
+    uint64_t totalNs = 0;
+};
+
+class Tracer {
+public:
+    static constexpr size_t DefaultEventsPerThread = 1 << 18;
+
+    static Tracer& Global() {
+        static Tracer instance;
+        return instance;
+    }
+
+    static bool Enabled() { return enabledFlag.load(std::memory_order_relaxed); }
+
+    static uint64_t Now() {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count());
+    }
+
+    // Clears everything recorded before and starts recording.
+    void Start(size_t maxEventsPerThread = DefaultEventsPerThread) {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (auto& buffer : buffers) {
+            std::lock_guard<std::mutex> bufferLock(buffer->mutex);
+            buffer->events.clear();
+            buffer->dropped = 0;
+            for (auto& histogram : buffer->histograms) histogram.Reset();
+            for (auto& total : buffer->totals) total = 0;
+        }
+        maxEvents.store(maxEventsPerThread, std::memory_order_relaxed);
+        startTime = Now();
+        enabledFlag.store(true, std::memory_order_relaxed);
+    }
+
+    // Recording stops; what was recorded stays for export until the next Start().
+    void Stop() {
+        enabledFlag.store(false, std::memory_order_relaxed);
+    }
+
+    void Record(TracePhase phase, uint64_t start, uint64_t duration, uint64_t arg = 0) {
+        ThreadBuffer& buffer = Local();
+        std::lock_guard<std::mutex> lock(buffer.mutex);
+        buffer.histograms[static_cast<size_t>(phase)].Record(duration);
+        buffer.totals[static_cast<size_t>(phase)] += duration;
+        if (buffer.events.size() < maxEvents.load(std::memory_order_relaxed)) {
+            buffer.events.push_back({start, duration, arg, phase});
+        } else {
+            buffer.dropped++;
+        }
+    }
+
+    // Histogram only, for intervals that do not belong on a thread's timeline.
+    void RecordLatency(TracePhase phase, uint64_t duration) {
+        ThreadBuffer& buffer = Local();
+        std::lock_guard<std::mutex> lock(buffer.mutex);
+        buffer.histograms[static_cast<size_t>(phase)].Record(duration);
+        buffer.totals[static_cast<size_t>(phase)] += duration;
+    }
+
+    LatencySummary Summary(TracePhase phase) const {
+        std::vector<uint64_t> merged;
+        LatencySummary summary;
+        std::lock_guard<std::mutex> lock(mutex);
+        for (const auto& buffer : buffers) {
+            std::lock_guard<std::mutex> bufferLock(buffer->mutex);
+            buffer->histograms[static_cast<size_t>(phase)].MergeInto(merged);
+            summary.totalNs += buffer->totals[static_cast<size_t>(phase)];
+        }
+        for (uint64_t count : merged) summary.count += count;
+        summary.p50Ns = LatencyHistogram::Percentile(merged, 0.5);
+        summary.p99Ns = LatencyHistogram::Percentile(merged, 0.99);
+        return summary;
+    }
+
+    // One line per phase that saw any calls, e.g. "unlink: 200000 calls, p50 8.2 us,
+    // p99 16.4 us, 1843 ms total".
+    std::vector<std::string> SummaryLines() const {
+        std::vector<std::string> lines;
+        for (size_t i = 0; i < static_cast<size_t>(TracePhase::Count); ++i) {
+            LatencySummary summary = Summary(static_cast<TracePhase>(i));
+            if (summary.count == 0) continue;
+            std::ostringstream line;
+            line << std::fixed << std::setprecision(1) << TracePhaseName(static_cast<TracePhase>(i)) << ": "
+                 << summary.count << " calls, p50 " << summary.p50Ns / 1000.0 << " us, p99 " << summary.p99Ns / 1000.0
+                 << " us, " << std::setprecision(0) << summary.totalNs / 1e6 << " ms total";
+            lines.push_back(line.str());
+        }
+        return lines;
+    }
+
+    uint64_t DroppedEvents() const {
+        uint64_t dropped = 0;
+        std::lock_guard<std::mutex> lock(mutex);
+        for (const auto& buffer : buffers) {
+            std::lock_guard<std::mutex> bufferLock(buffer->mutex);
+            dropped += buffer->dropped;
+        }
+        return dropped;
+    }
+
+    bool WriteChromeTrace(const std::string& filePath) const {
+        std::ofstream file(filePath, std::ios::trunc);
+        if (!file) return false;
+        file << std::fixed << std::setprecision(3) << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+        bool first = true;
+        std::lock_guard<std::mutex> lock(mutex);
+        for (const auto& buffer : buffers) {
+            std::lock_guard<std::mutex> bufferLock(buffer->mutex);
+            if (buffer->events.empty()) continue;
+            file << (first ? "" : ",") << "\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer->tid
+                 << ",\"args\":{\"name\":\"thread " << buffer->tid << "\"}}";
+            first = false;
+            for (const auto& event : buffer->events) {
+                if (event.start < startTime) continue;
+                file << ",\n{\"name\":\"" << TracePhaseName(event.phase) << "\",\"cat\":\"" << Category(event.phase)
+                     << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer->tid << ",\"ts\":" << (event.start - startTime) / 1000.0
+                     << ",\"dur\":" << event.duration / 1000.0;
+                if (event.phase == TracePhase::Task) file << ",\"args\":{\"queuedUs\":" << event.arg / 1000.0 << "}";
+                file << "}";
+            }
+        }
+        file << "\n]}\n";
+        return static_cast<bool>(file);
+    }
+
+private:
+    struct TraceEvent {
+        uint64_t start;
+        uint64_t duration;
+        uint64_t arg;
+        TracePhase phase;
+    };
+
+    struct ThreadBuffer {
+        mutable std::mutex mutex;  // taken by the owner per event and by exports, so never contended for long
+        std::vector<TraceEvent> events;
+        uint64_t dropped = 0;
+        LatencyHistogram histograms[static_cast<size_t>(TracePhase::Count)];
+        uint64_t totals[static_cast<size_t>(TracePhase::Count)] = {};
+        uint32_t tid = 0;
+    };
+
+    static const char* Category(TracePhase phase) {
+        switch (phase) {
+            case TracePhase::Sizing: return "walk";
+            case TracePhase::Task: return "scheduler";
+            default: return "syscall";
+        }
+    }
+
+    // Buffers are owned by the tracer too, so events of threads that have exited are
+    // still exported.
+    ThreadBuffer& Local() {
+        thread_local std::shared_ptr<ThreadBuffer> local;
+        if (!local) {
+            local = std::make_shared<ThreadBuffer>();
+            std::lock_guard<std::mutex> lock(mutex);
+            local->tid = static_cast<uint32_t>(buffers.size() + 1);
+            buffers.push_back(local);
+        }
+        return *local;
+    }
+
+    static inline std::atomic<bool> enabledFlag{false};
+
+    mutable std::mutex mutex;
+    std::vector<std::shared_ptr<ThreadBuffer>> buffers;
+    std::atomic<size_t> maxEvents{DefaultEventsPerThread};
+    uint64_t startTime = 0;
+};
+
+// Times its scope as one phase. Free while the tracer is off.
+class TraceSpan {
+public:
+    explicit TraceSpan(TracePhase phase) : phase(phase), start(Tracer::Enabled() ? Tracer::Now() : 0) {}
+
+    ~TraceSpan() {
+        if (start) Tracer::Global().Record(phase, start, Tracer::Now() - start, arg);
+    }
+
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+
+    void SetArg(uint64_t value) { arg = value; }
+
+private:
+    TracePhase phase;
+    uint64_t start;
+    uint64_t arg = 0;
+};
+
+// Runs call() inside a span and returns its result, for single calls in conditions:
+//   if (Traced(TracePhase::Unlink, [&]() { return ::unlinkat(fd, name, 0); }) == 0)
+template <typename Call>
+auto Traced(TracePhase phase, Call&& call) -> decltype(call()) {
+    TraceSpan span(phase);
+    return call();
+}
@@ -0,0 +1,373 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <limits>
+#include <fstream>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <system_error>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include "DiskCleanerSizeIndex.h"
+
+// =====================================================================================
+// USAGE INDEX
+// =====================================================================================
+// The directory tree of the last size calculation, kept for browsing: which
+// subdirectories make up a target's total, and how much each of them holds. Written
+// from the SizeIndex after a refresh, so it costs no extra walk, and answered without
+// touching the file system:
+//   - subtree totals are precomputed, "how big is X" is one array read
+//   - the children of a directory sit next to each other, largest subtree first, so
+//     "children of X by size" is a slice of the columns, no sort
+//   - the file is a flat struct-of-arrays that is mapped, not parsed: opening it costs
+//     the same for a hundred directories as for a million, and only the pages a query
+//     touches are read
+//
+// Nodes are directories (files are summed into their directory), numbered breadth
+// first; the roots come first and carry their full path as name, every other node its
+// own name. Only directories below a root that were reached by the refresh appear.
+//
+// On-disk format (native endianness, written to <file>.tmp then renamed over <file>):
+//   "DCUI" | u32 version | u64 node count | u64 root count | u64 name bytes
+//   columns, each padded to 8 bytes, in this order:
+//     u32 parent (None for roots), u32 first child, u32 child count,
+//     u32 name offset, u32 name length,
+//     u64 own bytes, u64 own files, u64 subtree bytes, u64 subtree files, i64 mtime
+//   name bytes
+// =====================================================================================
+
+class UsageIndex {
+public:
+    static constexpr uint32_t FormatVersion = 1;
+    static constexpr uint32_t None = std::numeric_limits<uint32_t>::max();
+
+    UsageIndex() = default;
+    ~UsageIndex() { Close(); }
+
+    UsageIndex(const UsageIndex&) = delete;
+    UsageIndex& operator=(const UsageIndex&) = delete;
+
+    // Writes the trees at roots as recorded in index. Roots the index does not know are
+    // left out. False if the file could not be written.
+    static bool Write(const std::string& filePath, const SizeIndex& index, const std::vector<std::string>& roots) {
+        struct Node {
+            std::string name;
+            uint32_t parent = None;
+            IndexedDirectory own;
+            std::vector<uint32_t> children;
+            uint64_t totalBytes = 0;
+            uint64_t totalFiles = 0;
+        };
+
+        // Gather breadth first, so every parent precedes its children.
+        std::vector<Node> nodes;
+        std::vector<std::string> paths;
+        for (const auto& root : roots) {
+            Node node;
+            if (!index.Find(root, node.own)) continue;
+            node.name = fs::path(root).string();
+            nodes.push_back(std::move(node));
+            paths.push_back(fs::path(root).string());
+        }
+        const size_t rootCount = nodes.size();
+        for (size_t i = 0; i < nodes.size(); ++i) {
+            std::vector<std::string> subdirs = std::move(nodes[i].own.subdirs);
+            for (auto& name : subdirs) {
+                if (nodes.size() + 1 >= None) return false;
+                Node child;
+                std::string path = (fs::path(paths[i]) / fs::path(name)).string();
+                if (!index.Find(path, child.own)) continue;
+                child.name = std::move(name);
+                child.parent = static_cast<uint32_t>(i);
+                nodes[i].children.push_back(static_cast<uint32_t>(nodes.size()));
+                nodes.push_back(std::move(child));
+                paths.push_back(std::move(path));
+            }
+        }
+        paths.clear();
+
+        for (size_t i = nodes.size(); i-- > 0;) {
+            Node& node = nodes[i];
+            node.totalBytes += node.own.bytes;
+            node.totalFiles += node.own.files;
+            if (node.parent != None) {
+                nodes[node.parent].totalBytes += node.totalBytes;
+                nodes[node.parent].totalFiles += node.totalFiles;
+            }
+        }
+
+        // Renumber breadth first again, now with every node's children largest first.
+        std::vector<uint32_t> order;
+        order.reserve(nodes.size());
+        for (uint32_t i = 0; i < rootCount; ++i) order.push_back(i);
+        std::vector<uint32_t> firstChild(nodes.size());
+        for (size_t i = 0; i < order.size(); ++i) {
+            Node& node = nodes[order[i]];
+            std::sort(node.children.begin(), node.children.end(), [&nodes](uint32_t a, uint32_t b) {
+                return nodes[a].totalBytes != nodes[b].totalBytes ? nodes[a].totalBytes > nodes[b].totalBytes
+                                                                  : nodes[a].name < nodes[b].name;
+            });
+            firstChild[i] = static_cast<uint32_t>(order.size());
+            order.insert(order.end(), node.children.begin(), node.children.end());
+        }
+        std::vector<uint32_t> position(nodes.size());
+        for (size_t i = 0; i < order.size(); ++i) position[order[i]] = static_cast<uint32_t>(i);
+
+        std::string names;
+        std::vector<uint32_t> parent, first, count, nameOffset, nameLength;
+        std::vector<uint64_t> ownBytes, ownFiles, totalBytes, totalFiles;
+        std::vector<int64_t> mtime;
+        for (size_t i = 0; i < order.size(); ++i) {
+            const Node& node = nodes[order[i]];
+            if (names.size() + node.name.size() >= None) return false;
+            parent.push_back(node.parent == None ? None : position[node.parent]);
+            first.push_back(firstChild[i]);
+            count.push_back(static_cast<uint32_t>(node.children.size()));
+            nameOffset.push_back(static_cast<uint32_t>(names.size()));
+            nameLength.push_back(static_cast<uint32_t>(node.name.size()));
+            names += node.name;
+            ownBytes.push_back(node.own.bytes);
+            ownFiles.push_back(node.own.files);
+            totalBytes.push_back(node.totalBytes);
+            totalFiles.push_back(node.totalFiles);
+            mtime.push_back(node.own.mtime);
+        }
+
+        std::string data("DCUI", 4);
+        Append(data, FormatVersion);
+        Append(data, static_cast<uint64_t>(order.size()));
+        Append(data, static_cast<uint64_t>(rootCount));
+        Append(data, static_cast<uint64_t>(names.size()));
+        AppendColumn(data, parent);
+        AppendColumn(data, first);
+        AppendColumn(data, count);
+        AppendColumn(data, nameOffset);
+        AppendColumn(data, nameLength);
+        AppendColumn(data, ownBytes);
+        AppendColumn(data, ownFiles);
+        AppendColumn(data, totalBytes);
+        AppendColumn(data, totalFiles);
+        AppendColumn(data, mtime);
+        data += names;
+
+        std::string tempPath = filePath + ".tmp";
+        {
+            std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+            if (!file) return false;
+            file.write(data.data(), static_cast<std::streamsize>(data.size()));
+            if (!file) return false;
+        }
+        std::error_code ec;
+        fs::rename(tempPath, filePath, ec);
+        return !ec;
+    }
+
+    // Maps filePath read-only. A missing, truncated or foreign file leaves the index
+    // closed and returns false.
+    bool Open(const std::string& filePath) {
+        Close();
+        if (!Map(filePath)) return false;
+
+        const char* data = static_cast<const char*>(view);
+        uint32_t version = 0;
+        uint64_t nodes = 0, roots = 0, nameBytes = 0;
+        if (length < HeaderBytes || std::memcmp(data, "DCUI", 4) != 0) return Fail();
+        std::memcpy(&version, data + 4, 4);
+        std::memcpy(&nodes, data + 8, 8);
+        std::memcpy(&roots, data + 16, 8);
+        std::memcpy(&nameBytes, data + 24, 8);
+        if (version != FormatVersion || nodes >= None || roots > nodes || nameBytes >= None) return Fail();
+        if (length != HeaderBytes + 5 * Padded(nodes * 4) + 5 * nodes * 8 + nameBytes) return Fail();
+
+        const char* column = data + HeaderBytes;
+        auto next32 = [&]() {
+            const uint32_t* values = reinterpret_cast<const uint32_t*>(column);
+            column += Padded(nodes * 4);
+            return values;
+        };
+        // Every column starts at a multiple of 8 from the page-aligned mapping.
+        auto next64 = [&]() {
+            const char* values = column;
+            column += nodes * 8;
+            return values;
+        };
+        parent = next32();
+        firstChild = next32();
+        childCount = next32();
+        nameOffset = next32();
+        nameLength = next32();
+        ownBytes = reinterpret_cast<const uint64_t*>(next64());
+        ownFiles = reinterpret_cast<const uint64_t*>(next64());
+        totalBytes = reinterpret_cast<const uint64_t*>(next64());
+        totalFiles = reinterpret_cast<const uint64_t*>(next64());
+        mtime = reinterpret_cast<const int64_t*>(next64());
+        names = column;
+        nodeCount = static_cast<uint32_t>(nodes);
+        rootCount = static_cast<uint32_t>(roots);
+        nameSize = static_cast<uint32_t>(nameBytes);
+        return true;
+    }
+
+    void Close() {
+        if (view) {
+#ifdef _WIN32
+            UnmapViewOfFile(view);
+#else
+            ::munmap(view, length);
+#endif
+        }
+        view = nullptr;
+        length = 0;
+        nodeCount = rootCount = nameSize = 0;
+    }
+
+    bool IsOpen() const { return view != nullptr; }
+
+    // Nodes are 0 .. Nodes() - 1, the roots 0 .. Roots() - 1. Accessors take any id and
+    // answer 0, None or empty for one out of range, so a damaged file cannot make them
+    // read outside the mapping.
+    uint32_t Nodes() const { return nodeCount; }
+    uint32_t Roots() const { return rootCount; }
+
+    uint32_t Parent(uint32_t node) const { return node < nodeCount && parent[node] < nodeCount ? parent[node] : None; }
+
+    // Children are FirstChild(node) .. FirstChild(node) + ChildCount(node) - 1, largest
+    // subtree first.
+    uint32_t FirstChild(uint32_t node) const { return node < nodeCount ? firstChild[node] : 0; }
+    uint32_t ChildCount(uint32_t node) const {
+        if (node >= nodeCount || firstChild[node] > nodeCount) return 0;
+        return (std::min)(childCount[node], nodeCount - firstChild[node]);
+    }
+
+    std::string_view Name(uint32_t node) const {
+        if (node >= nodeCount || nameOffset[node] > nameSize) return {};
+        return std::string_view(names + nameOffset[node], (std::min)(nameLength[node], nameSize - nameOffset[node]));
+    }
+
+    uint64_t OwnBytes(uint32_t node) const { return node < nodeCount ? ownBytes[node] : 0; }
+    uint64_t OwnFiles(uint32_t node) const { return node < nodeCount ? ownFiles[node] : 0; }
+    uint64_t SubtreeBytes(uint32_t node) const { return node < nodeCount ? totalBytes[node] : 0; }
+    uint64_t SubtreeFiles(uint32_t node) const { return node < nodeCount ? totalFiles[node] : 0; }
+    int64_t Mtime(uint32_t node) const { return node < nodeCount ? mtime[node] : 0; }
+
+    std::string Path(uint32_t node) const {
+        std::vector<uint32_t> chain;
+        for (uint32_t at = node; at != None && at < nodeCount && chain.size() <= nodeCount; at = Parent(at)) {
+            chain.push_back(at);
+        }
+        fs::path path;
+        for (size_t i = chain.size(); i-- > 0;) path /= fs::path(std::string(Name(chain[i])));
+        return path.string();
+    }
+
+    // The node of a directory path, or None if it is not in the index.
+    uint32_t Find(const std::string& dirPath) const {
+        fs::path target(dirPath);
+        for (uint32_t root = 0; root < rootCount; ++root) {
+            fs::path rootPath{std::string(Name(root))};
+            auto rootIt = rootPath.begin();
+            auto it = target.begin();
+            for (; rootIt != rootPath.end() && it != target.end() && *rootIt == *it; ++rootIt, ++it) {}
+            if (rootIt != rootPath.end() && !rootIt->empty()) continue;
+
+            uint32_t node = root;
+            for (; it != target.end() && node != None; ++it) {
+                if (it->empty()) continue;  // trailing separator
+                std::string name = it->string();
+                uint32_t first = FirstChild(node), count = ChildCount(node), match = None;
+                for (uint32_t child = first; child < first + count; ++child) {
+                    if (Name(child) == name) {
+                        match = child;
+                        break;
+                    }
+                }
+                node = match;
+            }
+            if (node != None) return node;
+        }
+        return None;
+    }
+
+private:
+    static constexpr uint64_t HeaderBytes = 32;
+
+    static uint64_t Padded(uint64_t bytes) { return (bytes + 7) & ~uint64_t(7); }
+
+    template <typename T>
+    static void Append(std::string& data, T value) {
+        data.append(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+
+    template <typename T>
+    static void AppendColumn(std::string& data, const std::vector<T>& values) {
+        data.append(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(T));
+        data.append(Padded(data.size()) - data.size(), '\0');
+    }
+
+    bool Fail() {
+        Close();
+        return false;
+    }
+
+    bool Map(const std::string& filePath) {
+#ifdef _WIN32
+        HANDLE file = CreateFileW(fs::u8path(filePath).wstring().c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE,
+                                  NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (file == INVALID_HANDLE_VALUE) return false;
+        LARGE_INTEGER size = {};
+        HANDLE mapping = NULL;
+        if (GetFileSizeEx(file, &size) && size.QuadPart > 0) {
+            mapping = CreateFileMappingW(file, NULL, PAGE_READONLY, 0, 0, NULL);
+        }
+        CloseHandle(file);
+        if (!mapping) return false;
+        view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        CloseHandle(mapping);
+        length = static_cast<size_t>(size.QuadPart);
+        return view != nullptr;
+#else
+        int fd = ::open(filePath.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) return false;
+        struct stat st;
+        if (::fstat(fd, &st) != 0 || st.st_size <= 0) {
+            ::close(fd);
+            return false;
+        }
+        void* mapped = ::mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (mapped == MAP_FAILED) return false;
+        view = mapped;
+        length = static_cast<size_t>(st.st_size);
+        return true;
+#endif
+    }
+
+    void* view = nullptr;
+    size_t length = 0;
+    uint32_t nodeCount = 0;
+    uint32_t rootCount = 0;
+    uint32_t nameSize = 0;
+    const uint32_t* parent = nullptr;
+    const uint32_t* firstChild = nullptr;
+    const uint32_t* childCount = nullptr;
+    const uint32_t* nameOffset = nullptr;
+    const uint32_t* nameLength = nullptr;
+    const uint64_t* ownBytes = nullptr;
+    const uint64_t* ownFiles = nullptr;
+    const uint64_t* totalBytes = nullptr;
+    const uint64_t* totalFiles = nullptr;
+    const int64_t* mtime = nullptr;
+    const char* names = nullptr;
+};
@@ -0,0 +1,782 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <filesystem>
+#include <thread>
+#include <atomic>
+#include <cstdint>
+#include <string_view>
+#include <mutex>
+#include <map>
+#include <functional>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+#include "DiskCleanerEngine.h"
+
+// =====================================================================================
+// WORK-STEALING DEQUE
+// =====================================================================================
+// Chase-Lev deque. The owning worker pushes and pops at the bottom without locks,
+// other workers steal from the top with a single CAS. T must be a pointer type.
+// Grown arrays are kept until the deque dies since a thief may still be reading one.
+// =====================================================================================
+
+template <typename T>
+class WorkStealingDeque {
+public:
+    explicit WorkStealingDeque(size_t initialCapacity = 256) {
+        retired.push_back(std::make_unique<Ring>(initialCapacity));
+        ring.store(retired.back().get(), std::memory_order_relaxed);
+    }
+
+    WorkStealingDeque(const WorkStealingDeque&) = delete;
+    WorkStealingDeque& operator=(const WorkStealingDeque&) = delete;
+
+    // Owner only.
+    void Push(T item) {
+        int64_t b = bottom.load(std::memory_order_relaxed);
+        int64_t t = top.load(std::memory_order_acquire);
+        Ring* r = ring.load(std::memory_order_relaxed);
+
+        if (b - t >= static_cast<int64_t>(r->capacity)) {
+            r = Grow(r, t, b);
+        }
+        r->Put(b, item);
+        std::atomic_thread_fence(std::memory_order_release);
+        bottom.store(b + 1, std::memory_order_relaxed);
+    }
+
+    // Owner only, LIFO end.
+    bool Pop(T& out) {
+        int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+        Ring* r = ring.load(std::memory_order_relaxed);
+        bottom.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t t = top.load(std::memory_order_relaxed);
+
+        if (t > b) {
+            bottom.store(b + 1, std::memory_order_relaxed);
+            return false;
+        }
+
+        out = r->Get(b);
+        if (t == b) {
+            bool won = top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+            bottom.store(b + 1, std::memory_order_relaxed);
+            return won;
+        }
+        return true;
+    }
+
+    // Any thread, FIFO end.
+    bool Steal(T& out) {
+        int64_t t = top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t b = bottom.load(std::memory_order_acquire);
+
+        if (t >= b) return false;
+
+        Ring* r = ring.load(std::memory_order_acquire);
+        T item = r->Get(t);
+        if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+            return false;
+        }
+        out = item;
+        return true;
+    }
+
+    bool Empty() const {
+        return bottom.load(std::memory_order_relaxed) <= top.load(std::memory_order_relaxed);
+    }
+
+private:
+    struct Ring {
+        size_t capacity;
+        std::unique_ptr<std::atomic<T>[]> slots;
+
+        explicit Ring(size_t capacity) : capacity(capacity), slots(new std::atomic<T>[capacity]) {}
+
+        void Put(int64_t index, T item) {
+            slots[static_cast<size_t>(index) & (capacity - 1)].store(item, std::memory_order_release);
+        }
+
+        T Get(int64_t index) const {
+            return slots[static_cast<size_t>(index) & (capacity - 1)].load(std::memory_order_acquire);
+        }
+    };
+
+    Ring* Grow(Ring* old, int64_t t, int64_t b) {
+        auto bigger = std::make_unique<Ring>(old->capacity * 2);
+        for (int64_t i = t; i < b; ++i) {
+            bigger->Put(i, old->Get(i));
+        }
+        Ring* r = bigger.get();
+        retired.push_back(std::move(bigger));
+        ring.store(r, std::memory_order_release);
+        return r;
+    }
+
+    alignas(64) std::atomic<int64_t> top{0};
+    alignas(64) std::atomic<int64_t> bottom{0};
+    std::atomic<Ring*> ring{nullptr};
+    std::vector<std::unique_ptr<Ring>> retired;
+};
+
+// =====================================================================================
+// PARALLEL WALKER
+// =====================================================================================
+// Sizes a single root with all cores. Every directory is a task; a worker lists it,
+// stats the files and pushes the subdirectories onto its own deque. Idle workers
+// steal the oldest (= closest to the root, usually biggest) directories from others.
+// =====================================================================================
+
+// =====================================================================================
+// INODE SET
+// =====================================================================================
+// Concurrent set of (device, inode) pairs. Keys are hashed into one of 64 shards, each
+// an open-addressing table of bare 16-byte keys behind its own mutex, so workers
+// rarely contend and memory stays near 16 bytes per entry / load factor instead of the
+// ~50 of a node-based set. (0, 0) means unknown identity and is never stored.
+// =====================================================================================
+
+class InodeSet {
+public:
+    static constexpr size_t ShardCount = 64;
+
+    // True if the pair was not in the set yet.
+    bool Insert(uint64_t device, uint64_t inode) {
+        if (device == 0 && inode == 0) return true;
+
+        uint64_t hash = Hash(device, inode);
+        Shard& shard = shards[hash >> 58];
+        std::lock_guard<std::mutex> lock(shard.mutex);
+
+        if ((shard.used + 1) * 10 > shard.slots.size() * 7) {
+            Grow(shard);
+        }
+        size_t mask = shard.slots.size() - 1;
+        for (size_t i = hash & mask;; i = (i + 1) & mask) {
+            Key& slot = shard.slots[i];
+            if (slot.device == 0 && slot.inode == 0) {
+                slot = {device, inode};
+                shard.used++;
+                return true;
+            }
+            if (slot.device == device && slot.inode == inode) return false;
+        }
+    }
+
+    size_t Size() const {
+        size_t total = 0;
+        for (const auto& shard : shards) {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            total += shard.used;
+        }
+        return total;
+    }
+
+    size_t MemoryBytes() const {
+        size_t total = sizeof(*this);
+        for (const auto& shard : shards) {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            total += shard.slots.capacity() * sizeof(Key);
+        }
+        return total;
+    }
+
+private:
+    struct Key {
+        uint64_t device;
+        uint64_t inode;
+    };
+
+    struct alignas(64) Shard {
+        mutable std::mutex mutex;
+        std::vector<Key> slots;
+        size_t used = 0;
+    };
+
+    static uint64_t Hash(uint64_t device, uint64_t inode) {
+        uint64_t h = inode ^ (device * 0x9E3779B97F4A7C15ull);
+        h ^= h >> 33;
+        h *= 0xFF51AFD7ED558CCDull;
+        h ^= h >> 33;
+        h *= 0xC4CEB9FE1A85EC53ull;
+        h ^= h >> 33;
+        return h;
+    }
+
+    static void Grow(Shard& shard) {
+        std::vector<Key> old = std::move(shard.slots);
+        shard.slots.assign(old.empty() ? 64 : old.size() * 2, Key{0, 0});
+        size_t mask = shard.slots.size() - 1;
+        for (const Key& key : old) {
+            if (key.device == 0 && key.inode == 0) continue;
+            size_t i = Hash(key.device, key.inode) & mask;
+            while (shard.slots[i].device != 0 || shard.slots[i].inode != 0) i = (i + 1) & mask;
+            shard.slots[i] = key;
+        }
+    }
+
+    Shard shards[ShardCount];
+};
+
+struct WalkTotals {
+    uintmax_t bytes = 0;
+    uintmax_t files = 0;
+    uintmax_t directories = 0;
+    uintmax_t reusedDirectories = 0;
+    uintmax_t duplicateBytes = 0;   // hard links to a file already counted
+    uintmax_t duplicateFiles = 0;
+    uintmax_t skippedDirectories = 0;  // reached again through a symlink
+    bool stopped = false;              // cancelled or past the deadline: totals are partial
+    uintmax_t entries = 0;
+    uintmax_t errors = 0;
+    uintmax_t syscalls = 0;
+};
+
+struct WalkOptions {
+    size_t threads = 0;
+    bool followDirectorySymlinks = false;
+    // Off: every link of a multiply-linked file is visited and counted.
+    bool countHardLinksOnce = true;
+    // Run the extra workers as tasks on this scheduler instead of threads of their own;
+    // threads is then capped at its worker count.
+    TaskScheduler* scheduler = nullptr;
+    // Checked before every directory and every 256 entries inside one.
+    const CancellationToken* cancel = nullptr;
+};
+
+// Identity and change stamp of a directory. mtime/ctime move whenever an entry is
+// added, removed or renamed in it; device/inode catch a directory replaced under the
+// same name. On Windows device/inode are the volume serial number and file index, and
+// only the last write time is kept.
+struct DirectoryStamp {
+    uint64_t device = 0;
+    uint64_t inode = 0;
+    int64_t mtime = 0;
+    int64_t ctime = 0;
+
+    bool operator==(const DirectoryStamp& other) const {
+        return device == other.device && inode == other.inode && mtime == other.mtime && ctime == other.ctime;
+    }
+};
+
+inline bool GetDirectoryStamp(const fs::path& dir, DirectoryStamp& out) {
+#ifdef _WIN32
+    // Opening resolves junctions and symlinks, so a reparse point gets the identity of
+    // the directory it leads to. The write time is the FILETIME value, the same count
+    // fs::last_write_time gives.
+    HANDLE handle = CreateFileW(dir.wstring().c_str(), FILE_READ_ATTRIBUTES,
+                                FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_EXISTING,
+                                FILE_FLAG_BACKUP_SEMANTICS, NULL);
+    if (handle == INVALID_HANDLE_VALUE) return false;
+    BY_HANDLE_FILE_INFORMATION info;
+    BOOL ok = GetFileInformationByHandle(handle, &info);
+    CloseHandle(handle);
+    if (!ok) return false;
+    out = {};
+    out.device = static_cast<uint64_t>(info.dwVolumeSerialNumber);
+    out.inode = (static_cast<uint64_t>(info.nFileIndexHigh) << 32) | info.nFileIndexLow;
+    out.mtime = static_cast<int64_t>((static_cast<uint64_t>(info.ftLastWriteTime.dwHighDateTime) << 32) |
+                                     info.ftLastWriteTime.dwLowDateTime);
+    return true;
+#else
+    struct stat st;
+    if (::stat(dir.c_str(), &st) != 0) return false;
+    out.device = static_cast<uint64_t>(st.st_dev);
+    out.inode = static_cast<uint64_t>(st.st_ino);
+#ifdef __linux__
+    out.mtime = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+    out.ctime = static_cast<int64_t>(st.st_ctim.tv_sec) * 1000000000 + st.st_ctim.tv_nsec;
+#else
+    out.mtime = static_cast<int64_t>(st.st_mtime) * 1000000000;
+    out.ctime = static_cast<int64_t>(st.st_ctime) * 1000000000;
+#endif
+    return true;
+#endif
+}
+
+// A file with more than one link as listed in one directory; counted says whether this
+// directory's totals include it or a link elsewhere was counted first.
+struct LinkedEntry {
+    uint64_t device = 0;
+    uint64_t inode = 0;
+    uint64_t size = 0;
+    bool counted = false;
+};
+
+// Directory hooks let a caller skip listing directories it already knows about.
+// Before listing, TryReuse(dir, stamp, own, subdirs, links) may fill in the directory's
+// own file totals, subdirectory names and multiply-linked files and return true; the
+// walker then decides again which links this walk counts (the directory that counted a
+// file last time may since have changed or gone), adjusts own and, if that changed
+// anything, hands the result back to Store. It only descends into those subdirectories.
+// After a directory has been listed, Store(dir, stamp, own, subdirs, links) receives the
+// fresh values. Both are called concurrently from all workers.
+struct NoDirectoryHook {
+    static constexpr bool Enabled = false;
+
+    bool TryReuse(const fs::path&, const DirectoryStamp&, WalkTotals&, std::vector<std::string>&,
+                  std::vector<LinkedEntry>&) { return false; }
+    void Store(const fs::path&, const DirectoryStamp&, const WalkTotals&, std::vector<std::string>&,
+               std::vector<LinkedEntry>&) {}
+};
+
+class ParallelWalker {
+public:
+    explicit ParallelWalker(WalkOptions options = {}) : options(options) {
+        if (this->options.threads == 0) {
+            this->options.threads = (std::max)(1u, std::thread::hardware_concurrency());
+        }
+        if (this->options.scheduler) {
+            this->options.threads = (std::min)(this->options.threads, this->options.scheduler->Workers());
+        }
+    }
+
+    WalkTotals Walk(const std::string& rootPath) {
+        return Walk(rootPath, [](size_t, const fs::path&, std::string_view, const EntryStat&) {});
+    }
+
+    // visitFile(workerIndex, dirPath, name, stat) is called for every non-directory
+    // entry, from the worker that found it. name is a view into the reader's buffer and
+    // only valid during the call. workerIndex is < Threads() so visitors can keep
+    // per-worker state without locking.
+    template <typename FileVisitor>
+    WalkTotals Walk(const std::string& rootPath, FileVisitor&& visitFile) {
+        NoDirectoryHook hook;
+        return Walk(rootPath, visitFile, hook);
+    }
+
+    // Same walk with a directory hook (see NoDirectoryHook). visitFile is not called for
+    // files of directories the hook reused.
+    template <typename FileVisitor, typename DirectoryHook>
+    WalkTotals Walk(const std::string& rootPath, FileVisitor&& visitFile, DirectoryHook& hook) {
+        TraceSpan span(TracePhase::Sizing);
+        EntryStat rootStat;
+        if (!StatEntry(rootPath, rootStat)) return {};
+        if (rootStat.type == fs::file_type::symlink && options.followDirectorySymlinks) {
+            std::error_code ec;
+            if (fs::is_directory(rootPath, ec)) rootStat.type = fs::file_type::directory;
+        }
+        if (rootStat.type != fs::file_type::directory) {
+            WalkTotals totals;
+            if (rootStat.type == fs::file_type::regular) {
+                totals.bytes = rootStat.size;
+                totals.files = 1;
+            }
+            return totals;
+        }
+
+        const size_t workerCount = options.threads;
+        std::vector<std::unique_ptr<Worker>> workers;
+        for (size_t i = 0; i < workerCount; ++i) {
+            workers.push_back(std::make_unique<Worker>(i));
+        }
+
+        // Files with more than one link are counted at their first link only. Directories
+        // can only be reached twice through followed symlinks, so they are tracked then.
+        InodeSet linkedFiles;
+        InodeSet visitedDirectories;
+        Identities identities{linkedFiles, options.followDirectorySymlinks ? &visitedDirectories : nullptr};
+
+        std::atomic<size_t> pending{1};
+        workers[0]->queue.Push(new fs::path(rootPath));
+
+        // On a scheduler, helpers hold a shared worker only while there is work for them:
+        // a helper that finds none parks (returns), and a worker that leaves directories
+        // in its queue while helpers are parked submits one again. The calling thread
+        // (worker 0) never parks, so the walk finishes even if a wakeup comes late.
+        std::unique_ptr<TaskGroup> helpers;
+        if (options.scheduler && workerCount > 1) helpers = std::make_unique<TaskGroup>(*options.scheduler);
+        std::atomic<size_t> parked{workerCount - 1};
+        std::function<void(size_t)> run;
+
+        auto wakeHelper = [&]() {
+            // Pairs with the fence in a parking helper: either it sees this push or this
+            // sees it parked.
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (parked.load(std::memory_order_relaxed) == 0) return;
+            for (size_t i = 1; i < workerCount; ++i) {
+                bool expected = false;
+                if (workers[i]->scheduled.compare_exchange_strong(expected, true, std::memory_order_acq_rel)) {
+                    parked.fetch_sub(1, std::memory_order_relaxed);
+                    helpers->Run([&run, i]() { run(i); });
+                    return;
+                }
+            }
+        };
+
+        // A helper's deque is only touched while its scheduled flag is held, so two runs of
+        // the same worker never overlap.
+        auto park = [&](Worker& self) {
+            self.scheduled.store(false, std::memory_order_release);
+            parked.fetch_add(1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (pending.load(std::memory_order_acquire) == 0) return true;
+            bool queued = false;
+            for (const auto& worker : workers) queued = queued || !worker->queue.Empty();
+            bool expected = false;
+            if (!queued || !self.scheduled.compare_exchange_strong(expected, true, std::memory_order_acq_rel)) return true;
+            parked.fetch_sub(1, std::memory_order_relaxed);
+            return false;
+        };
+
+        run = [&](size_t index) {
+            Worker& self = *workers[index];
+            const bool parks = helpers && index != 0;
+            fs::path* dir = nullptr;
+            int idleSpins = 0;
+
+            while (true) {
+                if (self.queue.Pop(dir) || StealWork(workers, self, dir)) {
+                    idleSpins = 0;
+                    // Once stopped, the rest of the queue is only drained.
+                    if (options.cancel && !options.cancel->Checkpoint()) {
+                        self.totals.stopped = true;
+                    } else {
+                        ProcessDirectory(*dir, self, pending, identities, visitFile, hook);
+                    }
+                    delete dir;
+                    pending.fetch_sub(1, std::memory_order_acq_rel);
+                    if (helpers && !self.queue.Empty()) wakeHelper();
+                    continue;
+                }
+                if (pending.load(std::memory_order_acquire) == 0) break;
+                if (parks) {
+                    if (++idleSpins <= 64) {
+                        std::this_thread::yield();
+                    } else if (park(self)) {
+                        return;
+                    } else {
+                        idleSpins = 0;
+                    }
+                    continue;
+                }
+                if (++idleSpins > 64) {
+                    std::this_thread::sleep_for(std::chrono::microseconds(50));
+                } else {
+                    std::this_thread::yield();
+                }
+            }
+            if (parks) {
+                self.scheduled.store(false, std::memory_order_release);
+                parked.fetch_add(1, std::memory_order_relaxed);
+            }
+        };
+
+        if (helpers) {
+            run(0);
+            helpers->Wait();
+        } else {
+            std::vector<std::thread> threads;
+            for (size_t i = 1; i < workerCount; ++i) {
+                threads.emplace_back(run, i);
+            }
+            run(0);
+            for (auto& thread : threads) {
+                thread.join();
+            }
+        }
+
+        WalkTotals totals;
+        for (const auto& worker : workers) {
+            totals.bytes += worker->totals.bytes;
+            totals.files += worker->totals.files;
+            totals.directories += worker->totals.directories;
+            totals.reusedDirectories += worker->totals.reusedDirectories;
+            totals.duplicateBytes += worker->totals.duplicateBytes;
+            totals.duplicateFiles += worker->totals.duplicateFiles;
+            totals.skippedDirectories += worker->totals.skippedDirectories;
+            totals.stopped = totals.stopped || worker->totals.stopped;
+            totals.entries += worker->totals.entries;
+            totals.errors += worker->totals.errors;
+            totals.syscalls += worker->totals.syscalls;
+        }
+        return totals;
+    }
+
+    size_t Threads() const { return options.threads; }
+
+private:
+    struct alignas(64) Worker {
+        explicit Worker(size_t index) : index(index), rng(static_cast<uint32_t>(index * 2654435761u + 1)) {}
+
+        size_t index;
+        uint32_t rng;
+        WorkStealingDeque<fs::path*> queue;
+        WalkTotals totals;
+        std::atomic<bool> scheduled{false};  // a helper task runs this worker
+    };
+
+    struct Identities {
+        InodeSet& linkedFiles;
+        InodeSet* visitedDirectories;
+    };
+
+    WalkOptions options;
+
+    static bool StealWork(std::vector<std::unique_ptr<Worker>>& workers, Worker& self, fs::path*& out) {
+        const size_t count = workers.size();
+        if (count < 2) return false;
+
+        self.rng ^= self.rng << 13;
+        self.rng ^= self.rng >> 17;
+        self.rng ^= self.rng << 5;
+        size_t start = self.rng % count;
+
+        for (size_t i = 0; i < count; ++i) {
+            Worker& victim = *workers[(start + i) % count];
+            if (&victim == &self) continue;
+            if (victim.queue.Steal(out)) return true;
+        }
+        return false;
+    }
+
+    static bool ReaderIdentity(const DirectoryReader& reader, const fs::path& dir, DirectoryStamp& out) {
+#ifdef __linux__
+        (void)dir;
+        struct stat st;
+        if (::fstat(reader.Fd(), &st) != 0) return false;
+        out.device = static_cast<uint64_t>(st.st_dev);
+        out.inode = static_cast<uint64_t>(st.st_ino);
+        return true;
+#else
+        (void)reader;
+        return GetDirectoryStamp(dir, out);
+#endif
+    }
+
+    template <typename FileVisitor, typename DirectoryHook>
+    void ProcessDirectory(const fs::path& dir, Worker& self, std::atomic<size_t>& pending, Identities& identities,
+                          FileVisitor& visitFile, DirectoryHook& hook) {
+        DirectoryStamp stamp;
+        WalkTotals own;
+        std::vector<std::string> subdirs;
+        std::vector<LinkedEntry> links;
+        bool stamped = false;
+
+        if constexpr (DirectoryHook::Enabled) {
+            self.totals.syscalls++;
+            stamped = GetDirectoryStamp(dir, stamp);
+            if (stamped && identities.visitedDirectories &&
+                !identities.visitedDirectories->Insert(stamp.device, stamp.inode)) {
+                self.totals.skippedDirectories++;
+                return;
+            }
+            if (stamped && hook.TryReuse(dir, stamp, own, subdirs, links)) {
+                bool moved = false;
+                for (LinkedEntry& link : links) {
+                    bool counted = !options.countHardLinksOnce || identities.linkedFiles.Insert(link.device, link.inode);
+                    if (counted != link.counted) {
+                        moved = true;
+                        link.counted = counted;
+                        if (counted) {
+                            own.bytes += link.size;
+                            own.files++;
+                        } else {
+                            own.bytes -= link.size;
+                            own.files--;
+                        }
+                    }
+                    if (!counted) {
+                        self.totals.duplicateBytes += link.size;
+                        self.totals.duplicateFiles++;
+                    }
+                }
+                self.totals.bytes += own.bytes;
+                self.totals.files += own.files;
+                self.totals.directories++;
+                self.totals.reusedDirectories++;
+                for (const auto& subdir : subdirs) {
+                    pending.fetch_add(1, std::memory_order_relaxed);
+                    self.queue.Push(new fs::path(dir / fs::path(subdir)));
+                }
+                if (moved) hook.Store(dir, stamp, own, subdirs, links);
+                return;
+            }
+        }
+
+        DirectoryReader reader(dir.string());
+        if (!reader.IsOpen()) {
+            self.totals.errors++;
+            self.totals.syscalls += reader.Syscalls();
+            return;
+        }
+        if (!DirectoryHook::Enabled && identities.visitedDirectories) {
+            DirectoryStamp identity;
+            self.totals.syscalls++;
+            if (ReaderIdentity(reader, dir, identity) &&
+                !identities.visitedDirectories->Insert(identity.device, identity.inode)) {
+                self.totals.skippedDirectories++;
+                self.totals.syscalls += reader.Syscalls();
+                return;
+            }
+        }
+        self.totals.directories++;
+
+        size_t sinceCheck = 0;
+        DirEntryView entry;
+        while (reader.Next(entry)) {
+            if (options.cancel && ++sinceCheck % 256 == 0 && !options.cancel->Checkpoint()) {
+                // A half-listed directory is never handed to the hook.
+                self.totals.stopped = true;
+                self.totals.syscalls += reader.Syscalls();
+                return;
+            }
+            self.totals.entries++;
+
+            EntryStat st;
+            st.type = EntryKindToFileType(entry.kind);
+            bool follow = entry.kind == EntryKind::Symlink && options.followDirectorySymlinks;
+            if (entry.kind == EntryKind::Regular || entry.kind == EntryKind::Unknown || follow) {
+                self.totals.syscalls++;
+                if (!StatAt(reader, dir, entry, st, follow)) {
+                    self.totals.errors++;
+                    continue;
+                }
+            }
+
+            if (st.type == fs::file_type::directory) {
+                pending.fetch_add(1, std::memory_order_relaxed);
+                self.queue.Push(new fs::path(dir / fs::path(entry.name)));
+                if constexpr (DirectoryHook::Enabled) {
+                    subdirs.emplace_back(entry.name);
+                }
+                continue;
+            }
+
+            if (st.type == fs::file_type::regular) {
+                if (st.links > 1) {
+                    bool counted = !options.countHardLinksOnce || identities.linkedFiles.Insert(st.device, st.inode);
+                    if constexpr (DirectoryHook::Enabled) {
+                        links.push_back({st.device, st.inode, st.size, counted});
+                    }
+                    if (!counted) {
+                        self.totals.duplicateBytes += st.size;
+                        self.totals.duplicateFiles++;
+                        continue;
+                    }
+                }
+                self.totals.bytes += st.size;
+                self.totals.files++;
+                own.bytes += st.size;
+                own.files++;
+            }
+            visitFile(self.index, dir, entry.name, st);
+        }
+        self.totals.syscalls += reader.Syscalls();
+        if (reader.Error()) {
+            self.totals.errors++;
+            return;
+        }
+
+        if constexpr (DirectoryHook::Enabled) {
+            if (stamped) {
+                hook.Store(dir, stamp, own, subdirs, links);
+            }
+        }
+    }
+};
+
+inline uintmax_t GetFolderSizeParallel(const std::string& folderPath, WalkOptions options = {}) {
+    try {
+        ParallelWalker walker(options);
+        return walker.Walk(folderPath).bytes;
+    } catch (...) {
+        return 0;
+    }
+}
+
+// Pass one of a free-space budget (DiskCleanerBudget.h): a sizing walk that adds every
+// file the delete pass would offer the budget to its histogram of last-write times.
+// That is every entry that is not a directory (symlinks, fifos and sockets too, with
+// the size and time of their own lstat, as DeleteEngine::OfferFile sees them), and
+// symlinks are never followed. Files the filter or the retention policy keep are left
+// out, decided the way the delete engine does: the filter from the directory's scope
+// below root, retention per directory in listing order. Every link of a file counts, as
+// the delete pass charges each unlink. Each worker fills its own map, merged once at the
+// end. A walk stopped through options.cancel adds nothing, so a budget is never planned
+// from part of a tree.
+inline WalkTotals SurveyFreeSpace(FreeSpaceBudget& budget, const std::string& root, WalkOptions options = {},
+                                  const PathFilter* filter = nullptr, const RetentionPolicy& retention = {}) {
+    if (filter && filter->Empty()) filter = nullptr;
+    options.countHardLinksOnce = false;
+    options.followDirectorySymlinks = false;
+    const int64_t now = RetentionNow();
+
+    // Files of one directory are listed by one worker in one go, so a worker's directory
+    // is done once its next file comes from somewhere else.
+    struct Local {
+        std::map<int64_t, BudgetBucket> buckets;
+        fs::path currentDir;
+        bool started = false;
+        bool kept = false;  // the filter keeps the whole directory
+        FilterScope scope;
+        std::unique_ptr<RetentionSelector> selector;
+    };
+    // Scope of dir as the engine reaches it from root; false if a directory on the way
+    // is kept.
+    auto scopeOf = [&](const fs::path& dir, FilterScope& scope) {
+        scope = filter->Root();
+        for (const auto& part : dir.lexically_relative(fs::path(root))) {
+            std::string name = part.string();
+            if (name == "." || name.empty()) continue;
+            if (filter->Decide(scope, name, true) == FilterDecision::Keep) return false;
+            scope = filter->Enter(scope, name);
+        }
+        return true;
+    };
+
+    ParallelWalker walker(options);
+    std::vector<Local> local(walker.Threads());
+    WalkTotals totals = walker.Walk(root, [&](size_t worker, const fs::path& dir, std::string_view name, const EntryStat& st) {
+        Local& mine = local[worker];
+        if (!mine.started || dir.native() != mine.currentDir.native()) {
+            if (mine.selector) mine.selector->Finish();
+            mine.currentDir = dir;
+            mine.started = true;
+            mine.kept = filter && !scopeOf(dir, mine.scope);
+        }
+        if (mine.kept) return;
+        if (filter && filter->Decide(mine.scope, name, false) != FilterDecision::Delete) return;
+
+        int64_t mtime = st.mtime;
+        uintmax_t size = st.size;
+        if (st.type != fs::file_type::regular) {
+            // Listed by d_type without a stat; the delete pass stats everything it offers.
+            EntryStat own;
+            if (!StatEntry(dir / fs::path(name), own)) return;
+            mtime = own.mtime;
+            size = own.size;
+        }
+#ifdef _WIN32
+        std::error_code ec;
+        auto written = fs::last_write_time(dir / fs::path(name), ec);
+        if (ec) return;
+        mtime = std::chrono::duration_cast<std::chrono::nanoseconds>(written.time_since_epoch()).count();
+#endif
+        auto count = [&mine](RetentionCandidate&& candidate) {
+            BudgetBucket& bucket = mine.buckets[FreeSpaceBudget::BucketOf(candidate.mtime)];
+            bucket.bytes += candidate.size;
+            bucket.files++;
+        };
+        if (retention.Active()) {
+            if (!mine.selector) mine.selector = std::make_unique<RetentionSelector>(retention, now);
+            mine.selector->Offer(name, mtime, size, count);
+        } else {
+            count(RetentionCandidate{std::string(), mtime, size});
+        }
+    });
+    if (totals.stopped) return totals;
+    for (auto& mine : local) {
+        budget.AddSurvey(mine.buckets);
+        mine.buckets.clear();
+    }
+    return totals;
+}
@@ -0,0 +1,550 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+#include <mutex>
+#include <chrono>
+#include <cstdint>
+#include <cerrno>
+
+#include "DiskCleanerWalker.h"
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#endif
+
+// =====================================================================================
+// SIZE WATCHER
+// =====================================================================================
+// Keeps the sizes of a few roots current without rescanning them. Every directory under
+// a root is a node holding the bytes/files directly inside it plus the aggregate of its
+// subtree. On Linux each node has an inotify watch; events only mark their directory
+// dirty, and once a burst has settled (coalesceDelay) each dirty directory is listed
+// once, non-recursively. The difference to its previous own totals is added to every
+// ancestor, new subdirectories are scanned with the parallel walker and vanished ones
+// are subtracted as a whole.
+//
+// Directories that cannot get a watch (fs.inotify.max_user_watches exhausted, or any
+// platform without inotify) are checked every rescanInterval by comparing their stamp,
+// so only the ones that actually changed are listed again. Like the size index, a file
+// rewritten in place inside such a directory is only seen once the directory changes.
+//
+// A file with several links under one root counts once, like in a sizing walk: the
+// directory that lists it first owns it, and rescans of the others skip it. A file that
+// had one link when its directory was last listed is not owned by anyone, so a link
+// made to it later counts twice until that directory changes and is listed again.
+//
+// Not thread-safe: one thread owns the watcher and calls Poll() in a loop.
+// =====================================================================================
+
+struct WatchOptions {
+    std::chrono::milliseconds coalesceDelay{100};
+    std::chrono::milliseconds rescanInterval{30000};
+    size_t threads = 0;
+    size_t maxWatches = 0;  // 0 = as many as the kernel allows
+    // Stops scans and Poll(). Once it has stopped, totals may be partial and the watcher
+    // is only good for destroying.
+    const CancellationToken* cancel = nullptr;
+};
+
+struct WatchStats {
+    size_t directories = 0;
+    size_t watchedDirectories = 0;
+    size_t unwatchedDirectories = 0;
+    uint64_t events = 0;
+    uint64_t overflows = 0;
+    uint64_t batches = 0;
+    uint64_t directoriesRescanned = 0;
+    size_t memoryBytes = 0;
+
+    // Userspace bookkeeping only; the kernel charges roughly another 1 KB per watch.
+    double BytesPerDirectory() const {
+        return directories ? static_cast<double>(memoryBytes) / directories : 0;
+    }
+};
+
+class SizeWatcher {
+public:
+    explicit SizeWatcher(WatchOptions options = {}) : options(options) {
+#ifdef __linux__
+        inotifyFd = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+#endif
+        lastRescan = std::chrono::steady_clock::now();
+    }
+
+    ~SizeWatcher() {
+#ifdef __linux__
+        if (inotifyFd >= 0) ::close(inotifyFd);
+#endif
+    }
+
+    SizeWatcher(const SizeWatcher&) = delete;
+    SizeWatcher& operator=(const SizeWatcher&) = delete;
+
+    // False when change notifications are unavailable and everything is polled.
+    bool HasNotifications() const { return inotifyFd >= 0; }
+
+    // Scans rootPath (a directory) and starts tracking it. Returns the id for
+    // RootBytes()/RootFiles(). The scan stops early once options.cancel does.
+    size_t AddRoot(const std::string& rootPath) {
+        int node = AddSubtree(rootPath, -1);
+        roots.push_back(node);
+        return roots.size() - 1;
+    }
+
+    uintmax_t RootBytes(size_t id) const {
+        return id < roots.size() ? nodes[roots[id]].subtreeBytes : 0;
+    }
+
+    uintmax_t RootFiles(size_t id) const {
+        return id < roots.size() ? nodes[roots[id]].subtreeFiles : 0;
+    }
+
+    // Waits up to timeout for changes and applies them. Returns true if any root's size
+    // changed.
+    bool Poll(std::chrono::milliseconds timeout) {
+        if (Stopped()) return false;
+        auto before = RootTotals();
+
+        if (WaitForEvents(timeout)) {
+            // Let the burst settle so a directory being filled is listed once, not per file.
+            std::chrono::milliseconds delay = options.coalesceDelay;
+            while (delay.count() > 0 && WaitForEvents(delay)) {}
+        }
+
+        auto now = std::chrono::steady_clock::now();
+        if (now - lastRescan >= options.rescanInterval) {
+            lastRescan = now;
+            for (size_t i = 0; i < nodes.size(); ++i) {
+                if (!nodes[i].alive || nodes[i].wd >= 0) continue;
+                DirectoryStamp stamp;
+                if (!GetDirectoryStamp(nodes[i].path, stamp) || !(stamp == nodes[i].stamp)) {
+                    dirty.insert(static_cast<int>(i));
+                }
+            }
+        }
+
+        if (!dirty.empty()) {
+            ApplyDirty();
+        }
+        return RootTotals() != before;
+    }
+
+    WatchStats Stats() const {
+        WatchStats result = stats;
+        result.memoryBytes = sizeof(*this) + wdToNode.size() * (sizeof(std::pair<const int, int>) + 2 * sizeof(void*)) +
+                             wdToNode.bucket_count() * sizeof(void*) + nodes.capacity() * sizeof(Node);
+        for (const auto& node : nodes) {
+            if (!node.alive) continue;
+            result.directories++;
+            if (node.wd >= 0) result.watchedDirectories++;
+            else result.unwatchedDirectories++;
+            result.memoryBytes += node.path.capacity() + node.children.capacity() * sizeof(int) +
+                                  node.links.capacity() * sizeof(LinkKey);
+        }
+        result.memoryBytes += linkOwners.size() * (sizeof(std::pair<const LinkKey, int>) + 2 * sizeof(void*)) +
+                              linkOwners.bucket_count() * sizeof(void*);
+        return result;
+    }
+
+private:
+    // A multiply-linked file under one root.
+    struct LinkKey {
+        int root;
+        uint64_t device;
+        uint64_t inode;
+
+        bool operator==(const LinkKey& other) const {
+            return root == other.root && device == other.device && inode == other.inode;
+        }
+    };
+
+    struct LinkKeyHash {
+        size_t operator()(const LinkKey& key) const {
+            return std::hash<uint64_t>()(key.inode ^ (key.device * 0x9E3779B97F4A7C15ull) ^
+                                         (static_cast<uint64_t>(key.root) << 40));
+        }
+    };
+
+    struct LinkedFile {
+        std::string dir;
+        uint64_t device;
+        uint64_t inode;
+        uint64_t size;
+    };
+
+    struct Node {
+        std::string path;
+        int parent = -1;
+        int wd = -1;
+        bool alive = false;
+        DirectoryStamp stamp;
+        uint64_t ownBytes = 0;
+        uint64_t ownFiles = 0;
+        uint64_t subtreeBytes = 0;
+        uint64_t subtreeFiles = 0;
+        std::vector<int> children;
+        std::vector<LinkKey> links;  // multiply-linked files counted in ownBytes
+    };
+
+    struct ScanRecord {
+        DirectoryStamp stamp;
+        uint64_t bytes = 0;
+        uint64_t files = 0;
+        std::vector<std::string> subdirs;
+    };
+
+    // Collects what the walker saw per directory so the subtree can be built from it.
+    struct CollectHook {
+        static constexpr bool Enabled = true;
+
+        std::mutex mutex;
+        std::unordered_map<std::string, ScanRecord> records;
+
+        bool TryReuse(const fs::path&, const DirectoryStamp&, WalkTotals&, std::vector<std::string>&,
+                      std::vector<LinkedEntry>&) { return false; }
+
+        // Links are owned through the walk's visitor, see AddSubtree.
+        void Store(const fs::path& dir, const DirectoryStamp& stamp, const WalkTotals& own, std::vector<std::string>& subdirs,
+                   std::vector<LinkedEntry>&) {
+            std::lock_guard<std::mutex> lock(mutex);
+            ScanRecord& record = records[dir.string()];
+            record.stamp = stamp;
+            record.bytes = own.bytes;
+            record.files = own.files;
+            record.subdirs = std::move(subdirs);
+        }
+    };
+
+    std::vector<std::pair<uint64_t, uint64_t>> RootTotals() const {
+        std::vector<std::pair<uint64_t, uint64_t>> totals;
+        for (int root : roots) {
+            totals.emplace_back(nodes[root].subtreeBytes, nodes[root].subtreeFiles);
+        }
+        return totals;
+    }
+
+    bool Stopped() const { return options.cancel && options.cancel->StopRequested(); }
+
+    int RootOf(int node) const {
+        while (nodes[node].parent >= 0) node = nodes[node].parent;
+        return node;
+    }
+
+    // Releases the links a node counted. A link of the same file elsewhere is counted
+    // when its own directory is next listed.
+    void ReleaseLinks(int index) {
+        for (const LinkKey& key : nodes[index].links) {
+            auto it = linkOwners.find(key);
+            if (it != linkOwners.end() && it->second == index) linkOwners.erase(it);
+        }
+        nodes[index].links.clear();
+    }
+
+    int NewNode() {
+        if (!freeNodes.empty()) {
+            int index = freeNodes.back();
+            freeNodes.pop_back();
+            nodes[index] = Node();
+            return index;
+        }
+        nodes.emplace_back();
+        return static_cast<int>(nodes.size() - 1);
+    }
+
+    void AddToAncestors(int node, int64_t bytes, int64_t files) {
+        for (int current = node; current >= 0; current = nodes[current].parent) {
+            nodes[current].subtreeBytes += bytes;
+            nodes[current].subtreeFiles += files;
+        }
+    }
+
+    void Watch(int index) {
+#ifdef __linux__
+        Node& node = nodes[index];
+        if (inotifyFd < 0 || (options.maxWatches && wdToNode.size() >= options.maxWatches)) return;
+        int wd = ::inotify_add_watch(inotifyFd, node.path.c_str(),
+                                     IN_CREATE | IN_DELETE | IN_MODIFY | IN_MOVED_FROM | IN_MOVED_TO |
+                                     IN_DELETE_SELF | IN_ONLYDIR | IN_DONT_FOLLOW | IN_EXCL_UNLINK);
+        if (wd < 0) return;  // ENOSPC once max_user_watches is hit: left to the periodic rescan
+        auto previous = wdToNode.find(wd);
+        if (previous != wdToNode.end() && previous->second != index) {
+            nodes[previous->second].wd = -1;  // same directory under its old path
+        }
+        node.wd = wd;
+        wdToNode[wd] = index;
+#else
+        (void)index;
+#endif
+    }
+
+    void Unwatch(int index) {
+        Node& node = nodes[index];
+#ifdef __linux__
+        // Watches belong to inodes: a directory renamed within the tree hands the same wd
+        // to its node at the new path, which must keep it.
+        auto it = wdToNode.find(node.wd);
+        if (it != wdToNode.end() && it->second == index) {
+            ::inotify_rm_watch(inotifyFd, node.wd);
+            wdToNode.erase(it);
+        }
+#endif
+        node.wd = -1;
+    }
+
+    // Walks path in parallel, creates nodes for everything under it and hangs the
+    // subtree below parent. Returns the new node.
+    int AddSubtree(const std::string& path, int parent) {
+        CollectHook hook;
+        WalkOptions walkOptions;
+        walkOptions.threads = options.threads;
+        walkOptions.cancel = options.cancel;
+        ParallelWalker walker(walkOptions);
+        // The walk counts each linked file once; which directory it counted it in is
+        // collected per worker so the node can own it.
+        std::vector<std::vector<LinkedFile>> linked(walker.Threads());
+        walker.Walk(path, [&linked](size_t worker, const fs::path& dir, std::string_view, const EntryStat& st) {
+            if (st.type == fs::file_type::regular && st.links > 1) {
+                linked[worker].push_back({dir.string(), st.device, st.inode, st.size});
+            }
+        }, hook);
+
+        std::vector<int> created;
+        std::unordered_map<std::string, int> createdByPath;
+        std::vector<std::pair<std::string, int>> stack{{fs::path(path).string(), parent}};
+        while (!stack.empty()) {
+            auto [dirPath, parentIndex] = std::move(stack.back());
+            stack.pop_back();
+
+            int index = NewNode();
+            created.push_back(index);
+            Node& node = nodes[index];
+            node.path = dirPath;
+            node.parent = parentIndex;
+            node.alive = true;
+            if (parentIndex >= 0) nodes[parentIndex].children.push_back(index);
+            createdByPath.emplace(dirPath, index);
+
+            auto it = hook.records.find(dirPath);
+            if (it == hook.records.end()) continue;  // unreadable, stays at zero
+            node.stamp = it->second.stamp;
+            node.ownBytes = node.subtreeBytes = it->second.bytes;
+            node.ownFiles = node.subtreeFiles = it->second.files;
+            for (const auto& name : it->second.subdirs) {
+                stack.emplace_back((fs::path(dirPath) / fs::path(name)).string(), index);
+            }
+        }
+
+        // Links already owned by another directory of the root are taken back out.
+        int root = parent >= 0 ? RootOf(parent) : created.front();
+        for (const auto& files : linked) {
+            for (const LinkedFile& file : files) {
+                auto node = createdByPath.find(file.dir);
+                if (node == createdByPath.end()) continue;
+                LinkKey key{root, file.device, file.inode};
+                Node& owner = nodes[node->second];
+                if (linkOwners.emplace(key, node->second).second) {
+                    owner.links.push_back(key);
+                } else {
+                    owner.ownBytes -= file.size;
+                    owner.ownFiles--;
+                    owner.subtreeBytes -= file.size;
+                    owner.subtreeFiles--;
+                }
+            }
+        }
+
+        // Children were created after their parents, so one backwards pass sums subtrees.
+        for (auto it = created.rbegin(); it != created.rend(); ++it) {
+            const Node& node = nodes[*it];
+            if (node.parent >= 0 && *it != created.front()) {
+                nodes[node.parent].subtreeBytes += node.subtreeBytes;
+                nodes[node.parent].subtreeFiles += node.subtreeFiles;
+            }
+        }
+        const Node& top = nodes[created.front()];
+        if (parent >= 0) AddToAncestors(parent, static_cast<int64_t>(top.subtreeBytes), static_cast<int64_t>(top.subtreeFiles));
+
+        // Watches go on after the scan; anything that changed in between is caught by
+        // comparing stamps once the watch exists.
+        for (int index : created) {
+            Watch(index);
+            DirectoryStamp stamp;
+            if (!GetDirectoryStamp(nodes[index].path, stamp) || !(stamp == nodes[index].stamp)) {
+                dirty.insert(index);
+            }
+        }
+        return created.front();
+    }
+
+    void RemoveSubtree(int index) {
+        Node& top = nodes[index];
+        AddToAncestors(top.parent, -static_cast<int64_t>(top.subtreeBytes), -static_cast<int64_t>(top.subtreeFiles));
+
+        std::vector<int> stack{index};
+        while (!stack.empty()) {
+            int current = stack.back();
+            stack.pop_back();
+            Unwatch(current);
+            ReleaseLinks(current);
+            Node& node = nodes[current];
+            for (int child : node.children) stack.push_back(child);
+            node.alive = false;
+            node.children.clear();
+            node.path.clear();
+            dirty.erase(current);
+            released.push_back(current);
+        }
+    }
+
+    // Lists one directory without descending and reconciles the node with what is there.
+    void Rescan(int index) {
+        stats.directoriesRescanned++;
+        DirectoryStamp stamp;
+        if (!GetDirectoryStamp(nodes[index].path, stamp)) {
+            // Gone: the listing below comes back empty and the node drops to zero until
+            // its parent's rescan removes it.
+            stamp = {};
+        } else if (nodes[index].wd < 0) {
+            Watch(index);  // watches may have been freed up since, or the root came back
+        }
+
+        // This listing decides anew which linked files the directory owns.
+        ReleaseLinks(index);
+        int root = RootOf(index);
+        std::vector<LinkKey> links;
+
+        uint64_t bytes = 0;
+        uint64_t files = 0;
+        std::unordered_set<std::string> subdirs;
+        {
+            DirectoryReader reader(nodes[index].path);
+            DirEntryView entry;
+            while (reader.Next(entry)) {
+                EntryStat st;
+                st.type = EntryKindToFileType(entry.kind);
+                if (entry.kind == EntryKind::Regular || entry.kind == EntryKind::Unknown) {
+                    if (!StatAt(reader, nodes[index].path, entry, st)) continue;
+                }
+                if (st.type == fs::file_type::directory) {
+                    subdirs.emplace(entry.name);
+                } else if (st.type == fs::file_type::regular) {
+                    if (st.links > 1) {
+                        LinkKey key{root, st.device, st.inode};
+                        if (!linkOwners.emplace(key, index).second) continue;
+                        links.push_back(key);
+                    }
+                    bytes += st.size;
+                    files++;
+                }
+            }
+        }
+
+        Node& node = nodes[index];
+        node.stamp = stamp;
+        int64_t deltaBytes = static_cast<int64_t>(bytes) - static_cast<int64_t>(node.ownBytes);
+        int64_t deltaFiles = static_cast<int64_t>(files) - static_cast<int64_t>(node.ownFiles);
+        node.ownBytes = bytes;
+        node.ownFiles = files;
+        node.links = std::move(links);
+        AddToAncestors(index, deltaBytes, deltaFiles);
+
+        std::vector<int> children = nodes[index].children;
+        std::vector<int> kept;
+        for (int child : children) {
+            std::string name = fs::path(nodes[child].path).filename().string();
+            if (subdirs.erase(name)) {
+                kept.push_back(child);
+            } else {
+                RemoveSubtree(child);
+            }
+        }
+        nodes[index].children = std::move(kept);
+
+        for (const auto& name : subdirs) {
+            if (Stopped()) return;
+            AddSubtree((fs::path(nodes[index].path) / fs::path(name)).string(), index);
+        }
+    }
+
+    void ApplyDirty() {
+        stats.batches++;
+        while (!dirty.empty() && !Stopped()) {
+            int index = *dirty.begin();
+            dirty.erase(dirty.begin());
+            if (nodes[index].alive) Rescan(index);
+        }
+        // Slots freed during the batch are reused only now, so a stale dirty entry can
+        // never hit a node that was recycled under it.
+        freeNodes.insert(freeNodes.end(), released.begin(), released.end());
+        released.clear();
+    }
+
+    // Reads whatever events arrive within timeout and marks their directories dirty.
+    // Returns true if anything was read.
+    bool WaitForEvents(std::chrono::milliseconds timeout) {
+#ifdef __linux__
+        if (inotifyFd < 0) {
+            std::this_thread::sleep_for(timeout);
+            return false;
+        }
+
+        pollfd pfd{inotifyFd, POLLIN, 0};
+        if (::poll(&pfd, 1, static_cast<int>(timeout.count())) <= 0) return false;
+
+        alignas(inotify_event) char buffer[16 * 1024];
+        bool any = false;
+        while (true) {
+            ssize_t n = ::read(inotifyFd, buffer, sizeof(buffer));
+            if (n <= 0) break;
+            any = true;
+            for (char* p = buffer; p < buffer + n;) {
+                const auto* event = reinterpret_cast<const inotify_event*>(p);
+                p += sizeof(inotify_event) + event->len;
+                stats.events++;
+
+                if (event->mask & IN_Q_OVERFLOW) {
+                    // Events were lost: every directory has to be looked at again.
+                    stats.overflows++;
+                    for (size_t i = 0; i < nodes.size(); ++i) {
+                        if (nodes[i].alive) dirty.insert(static_cast<int>(i));
+                    }
+                    continue;
+                }
+                auto it = wdToNode.find(event->wd);
+                if (it == wdToNode.end()) continue;
+
+                Node& node = nodes[it->second];
+                if (event->mask & IN_DELETE_SELF) {
+                    // The kernel dropped the watch already; the parent's rescan removes the node.
+                    wdToNode.erase(it);
+                    node.wd = -1;
+                    if (node.parent >= 0) dirty.insert(node.parent);
+                    else dirty.insert(static_cast<int>(&node - nodes.data()));
+                    continue;
+                }
+                dirty.insert(it->second);
+            }
+        }
+        return any;
+#else
+        std::this_thread::sleep_for(timeout);
+        return false;
+#endif
+    }
+
+    WatchOptions options;
+    int inotifyFd = -1;
+    std::vector<Node> nodes;
+    std::vector<int> freeNodes;
+    std::vector<int> released;
+    std::vector<int> roots;
+    std::unordered_map<int, int> wdToNode;
+    std::unordered_map<LinkKey, int, LinkKeyHash> linkOwners;
+    std::unordered_set<int> dirty;
+    std::chrono::steady_clock::time_point lastRescan;
+    WatchStats stats;
+};